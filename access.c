@@ -0,0 +1,85 @@
+#include "access.h"
+
+static inline int set_access(MemoryAccess *a, uint16_t addr, int size, int kind)
+{
+  a->addr = addr;
+  a->size = size;
+  a->kind = kind;
+  return 1;
+}
+
+int DecodeMemoryAccess(CpuState *state, MemoryAccess *a)
+{
+  uint8_t *memory = state->memory;
+  uint8_t opcode = memory[state->pc];
+  uint16_t hl = (state->h << 8) | state->l;
+  uint16_t direct = memory[(uint16_t) (state->pc + 1)] |
+                    (memory[(uint16_t) (state->pc + 2)] << 8);
+
+  if (opcode == 0x76)
+  {
+    return 0;   //HLT sits where MOV M,M would be
+  }
+  if ((opcode & 0xc7) == 0x46 || (opcode & 0xc7) == 0x86)
+  {
+    return set_access(a, hl, 1, ACCESS_READ);    //MOV r,M and ALU M
+  }
+  if ((opcode & 0xf8) == 0x70 || opcode == 0x36)
+  {
+    return set_access(a, hl, 1, ACCESS_WRITE);   //MOV M,r and MVI M
+  }
+
+  switch (opcode)
+  {
+    case 0x34: //INR M
+    case 0x35: //DCR M
+      return set_access(a, hl, 1, ACCESS_READ | ACCESS_WRITE);
+    case 0x0a: //LDAX B
+      return set_access(a, (state->b << 8) | state->c, 1, ACCESS_READ);
+    case 0x1a: //LDAX D
+      return set_access(a, (state->d << 8) | state->e, 1, ACCESS_READ);
+    case 0x02: //STAX B
+      return set_access(a, (state->b << 8) | state->c, 1, ACCESS_WRITE);
+    case 0x12: //STAX D
+      return set_access(a, (state->d << 8) | state->e, 1, ACCESS_WRITE);
+    case 0x3a: //LDA
+      return set_access(a, direct, 1, ACCESS_READ);
+    case 0x32: //STA
+      return set_access(a, direct, 1, ACCESS_WRITE);
+    case 0x2a: //LHLD
+      return set_access(a, direct, 2, ACCESS_READ);
+    case 0x22: //SHLD
+      return set_access(a, direct, 2, ACCESS_WRITE);
+    case 0xe3: //XTHL
+      return set_access(a, state->sp, 2, ACCESS_READ | ACCESS_WRITE);
+    case 0xc9: //RET
+    case 0xd9:
+      return set_access(a, state->sp, 2, ACCESS_READ);
+    case 0xcd: //CALL
+    case 0xdd:
+    case 0xed:
+    case 0xfd:
+      return set_access(a, state->sp - 2, 2, ACCESS_WRITE);
+  }
+
+  switch (opcode & 0xcf)
+  {
+    case 0xc5: //PUSH
+      return set_access(a, state->sp - 2, 2, ACCESS_WRITE);
+    case 0xc1: //POP
+      return set_access(a, state->sp, 2, ACCESS_READ);
+  }
+
+  switch (opcode & 0xc7)
+  {
+    case 0xc7: //RST
+      return set_access(a, state->sp - 2, 2, ACCESS_WRITE);
+    case 0xc4: //Ccc
+      return ConditionHolds(state, opcode) &&
+             set_access(a, state->sp - 2, 2, ACCESS_WRITE);
+    case 0xc0: //Rcc
+      return ConditionHolds(state, opcode) &&
+             set_access(a, state->sp, 2, ACCESS_READ);
+  }
+  return 0;
+}
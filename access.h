@@ -0,0 +1,41 @@
+#ifndef I8080_ACCESS_H
+#define I8080_ACCESS_H
+
+#include <stdint.h>
+
+#include "emulator.h"
+
+// Memory access decoder: which bytes the instruction at state->pc will
+// read or write, worked out from the opcode and registers before it runs.
+// Every 8080 instruction touches at most one range of 1 or 2 bytes.
+// Conditional calls and returns only count when their condition holds.
+
+#define ACCESS_READ  0x01
+#define ACCESS_WRITE 0x02
+
+typedef struct {
+  uint16_t addr;
+  uint8_t  size;
+  uint8_t  kind;   // ACCESS_* bits
+} MemoryAccess;
+
+//   @return: 0 if the instruction does not touch memory beyond its own bytes
+int DecodeMemoryAccess(CpuState *state, MemoryAccess *access);
+
+// Whether the condition in bits 3-5 of a Jcc/Ccc/Rcc opcode holds
+static inline int ConditionHolds(CpuState *state, uint8_t opcode)
+{
+  switch ((opcode >> 3) & 7)
+  {
+    case 0: return !state->cc.z;
+    case 1: return state->cc.z;
+    case 2: return !state->cc.cy;
+    case 3: return state->cc.cy;
+    case 4: return !state->cc.p;
+    case 5: return state->cc.p;
+    case 6: return !state->cc.s;
+    default: return state->cc.s;
+  }
+}
+
+#endif /* I8080_ACCESS_H */
@@ -0,0 +1,31 @@
+#include "batch.h"
+
+int StepMany(Machine **handles, const uint8_t *inputs, int count, int frames,
+             uint8_t *framebuffers, uint32_t *scores)
+{
+  int running = 0;
+  int i, f;
+
+  for (i = 0; i < count; i++)
+  {
+    Machine *machine = handles[i];
+
+    //bit 3 is wired high on the cabinet
+    machine->in_port1 = inputs[i] | 0x08;
+
+    for (f = 0; f < frames && !machine->state->halted; f++)
+    {
+      MachineRunFrame(machine);
+    }
+
+    memcpy(&framebuffers[(size_t) i * MACHINE_VRAM_SIZE],
+           &machine->state->memory[MACHINE_VRAM_START], MACHINE_VRAM_SIZE);
+    scores[i] = MachineScore(machine);
+
+    if (!machine->state->halted)
+    {
+      running++;
+    }
+  }
+  return running;
+}
@@ -0,0 +1,23 @@
+#ifndef I8080_BATCH_H
+#define I8080_BATCH_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+// Advance many machines by the same number of frames.
+//   handles: machines to step
+//   inputs: port 1 value for each machine, held for all frames
+//   count: number of machines
+//   frames: frames to run on each machine
+//   framebuffers: caller buffer of count * MACHINE_VRAM_SIZE bytes, receives
+//                 each machine's video RAM after the last frame
+//   scores: caller buffer of count entries, receives player 1 score
+//   @return: number of machines still running (not halted)
+//
+// Machines share no state, so disjoint slices of the arrays may be stepped
+// from different threads at the same time. Nothing is allocated per call.
+int StepMany(Machine **handles, const uint8_t *inputs, int count, int frames,
+             uint8_t *framebuffers, uint32_t *scores);
+
+#endif /* I8080_BATCH_H */
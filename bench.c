@@ -0,0 +1,339 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpm.h"
+#include "lockstep.h"
+#include "machine.h"
+#include "runloop.h"
+
+// Emulated seconds of invaders attract mode
+#define DEFAULT_INVADERS_SECONDS 10
+// Instructions per synthetic loop run
+#define DEFAULT_SYNTHETIC_STEPS  20000000
+// Runs per workload, the fastest one is reported
+#define DEFAULT_REPEATS          3
+
+typedef struct {
+  uint64_t instructions;
+  uint64_t cycles;
+  double   seconds;
+  int64_t  cache_misses;   // -1 when perf counters are unavailable
+  int      matches;        // lockstep lanes agree with the scalar core, -1 if not compared
+} BenchResult;
+
+/* Cache miss counter through perf_event_open, if the kernel lets us */
+static int open_cache_misses(void)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int perf_fd = -1;
+
+static void bench_start(BenchResult *result)
+{
+  memset(result, 0, sizeof(BenchResult));
+  result->matches = -1;
+  if (perf_fd >= 0)
+  {
+    ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  result->seconds = now_seconds();
+}
+
+static void bench_stop(BenchResult *result)
+{
+  result->seconds = now_seconds() - result->seconds;
+  result->cache_misses = -1;
+  if (perf_fd >= 0)
+  {
+    int64_t count;
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(perf_fd, &count, sizeof(count)) == sizeof(count))
+    {
+      result->cache_misses = count;
+    }
+  }
+}
+
+/* Workloads */
+static void bench_invaders(BenchResult *result, int seconds)
+{
+  Machine *machine = InitMachine();
+  int frames = seconds * MACHINE_FRAMES_PER_SEC;
+  int f;
+
+  bench_start(result);
+  for (f = 0; f < frames && MachineRunFrame(machine); f++)
+    ;
+  bench_stop(result);
+
+  result->instructions = machine->instructions;
+  result->cycles = machine->state->cycles;
+  FreeMachine(machine);
+}
+
+// A full lockstep group against as many machines run one after the other
+// by MachineRunFrame; every lane has to end with the same hash and cycles
+static void bench_lockstep(BenchResult *lockstep, BenchResult *plain, int seconds)
+{
+  Machine *machines[LOCKSTEP_LANES];
+  Machine *reference[LOCKSTEP_LANES];
+  LockstepGroup *group = malloc(sizeof(LockstepGroup));
+  int frames = seconds * MACHINE_FRAMES_PER_SEC;
+  int f, i;
+
+  for (i = 0; i < LOCKSTEP_LANES; i++)
+  {
+    machines[i] = InitMachine();
+    reference[i] = InitMachine();
+  }
+
+  bench_start(plain);
+  for (i = 0; i < LOCKSTEP_LANES; i++)
+  {
+    for (f = 0; f < frames && MachineRunFrame(reference[i]); f++)
+      ;
+  }
+  bench_stop(plain);
+
+  bench_start(lockstep);
+  LockstepLoad(group, machines, LOCKSTEP_LANES);
+  for (f = 0; f < frames; f++)
+  {
+    LockstepRunFrame(group);
+  }
+  LockstepStore(group);
+  bench_stop(lockstep);
+
+  lockstep->matches = 1;
+  for (i = 0; i < LOCKSTEP_LANES; i++)
+  {
+    plain->instructions += reference[i]->instructions;
+    plain->cycles += reference[i]->state->cycles;
+    lockstep->instructions += machines[i]->instructions;
+    lockstep->cycles += machines[i]->state->cycles;
+    if (Hash8080(machines[i]->state) != Hash8080(reference[i]->state) ||
+        machines[i]->state->cycles != reference[i]->state->cycles)
+    {
+      lockstep->matches = 0;
+    }
+    FreeMachine(machines[i]);
+    FreeMachine(reference[i]);
+  }
+  free(group);
+}
+
+static void bench_cpudiag(BenchResult *result)
+{
+  FILE *out = fopen("/dev/null", "w");
+  CpmMachine *cpm = InitCpm(out);
+
+  CpmLoad(cpm, "cpudiag.bin");
+  bench_start(result);
+  result->instructions = RunLoopCpm(cpm->state, UINT64_MAX, cpm);
+  bench_stop(result);
+
+  result->cycles = cpm->state->cycles;
+  CpmFlush(cpm);
+  FreeCpm(cpm);
+  fclose(out);
+}
+
+// Straight-line bodies ending in a jump back to 0
+typedef struct {
+  const char    *name;
+  const uint8_t *code;
+  size_t        size;
+} SyntheticLoop;
+
+static const uint8_t loop_mov[] = {
+  0x41, 0x4a, 0x53, 0x5c, 0x65, 0x6f, 0x78, 0x47,  //MOV r,r
+  0xc3, 0x00, 0x00,                                //JMP 0
+};
+static const uint8_t loop_alu[] = {
+  0x80, 0x88, 0x90, 0x98, 0xa0, 0xa8, 0xb0,        //ADD ADC SUB SBB ANA XRA ORA
+  0xc6, 0x01,                                      //ADI 1
+  0xc3, 0x00, 0x00,
+};
+static const uint8_t loop_memory[] = {
+  0x21, 0x00, 0x20,                                //LXI H,$2000
+  0x77, 0x7e, 0x34, 0x86, 0x23, 0x35,              //MOV M,A MOV A,M INR M ADD M INX H DCR M
+  0x32, 0x00, 0x21, 0x3a, 0x00, 0x21,              //STA $2100 LDA $2100
+  0xc3, 0x00, 0x00,
+};
+static const uint8_t loop_stack[] = {
+  0x31, 0x00, 0x24,                                //LXI SP,$2400
+  0xc5, 0xd5, 0xe5, 0xf5, 0xf1, 0xe1, 0xd1, 0xc1,  //PUSH B D H PSW, POP PSW H D B
+  0xc3, 0x00, 0x00,
+};
+static const uint8_t loop_branch[] = {
+  0x31, 0x00, 0x24,                                //LXI SP,$2400
+  0xcd, 0x10, 0x00,                                //CALL $0010
+  0xaf, 0xc2, 0x00, 0x00,                          //XRA A, JNZ 0 (not taken)
+  0xca, 0x00, 0x00,                                //JZ 0 (taken)
+  0x00, 0x00, 0x00,
+  0xc9,                                            //$0010: RET
+};
+
+static const SyntheticLoop synthetic_loops[] = {
+  { "synthetic_mov",    loop_mov,    sizeof(loop_mov) },
+  { "synthetic_alu",    loop_alu,    sizeof(loop_alu) },
+  { "synthetic_memory", loop_memory, sizeof(loop_memory) },
+  { "synthetic_stack",  loop_stack,  sizeof(loop_stack) },
+  { "synthetic_branch", loop_branch, sizeof(loop_branch) },
+};
+
+static void bench_synthetic(BenchResult *result, const SyntheticLoop *loop,
+                            uint64_t steps)
+{
+  CpuState *state = Init8080();
+
+  memcpy(state->memory, loop->code, loop->size);
+  bench_start(result);
+  result->instructions = RunLoopPlain(state, steps, NULL);
+  bench_stop(result);
+
+  result->cycles = state->cycles;
+  Free8080(state);
+}
+
+/* Report */
+static int first_result = 1;
+
+static void print_result(const char *name, BenchResult *result)
+{
+  double ips = result->instructions / result->seconds;
+
+  printf("%s\n    {\"name\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, "
+         "\"seconds\": %.6f, \"instructions_per_sec\": %.0f, "
+         "\"emulated_mhz\": %.3f, \"ns_per_instruction\": %.3f, \"cache_misses\": ",
+         first_result ? "" : ",", name,
+         (unsigned long long) result->instructions,
+         (unsigned long long) result->cycles, result->seconds, ips,
+         result->cycles / result->seconds / 1e6, 1e9 / ips);
+  if (result->cache_misses >= 0)
+  {
+    printf("%lld", (long long) result->cache_misses);
+  }
+  else
+  {
+    printf("null");
+  }
+  if (result->matches >= 0)
+  {
+    printf(", \"matches_scalar\": %s", result->matches ? "true" : "false");
+  }
+  printf("}");
+  first_result = 0;
+}
+
+static void keep_fastest(BenchResult *best, BenchResult *result, int run)
+{
+  if (run == 0 || result->seconds < best->seconds)
+  {
+    *best = *result;
+  }
+}
+
+int main (int argc, char** argv)
+{
+  int invaders_seconds = DEFAULT_INVADERS_SECONDS;
+  uint64_t synthetic_steps = DEFAULT_SYNTHETIC_STEPS;
+  int repeats = DEFAULT_REPEATS;
+  BenchResult best, result, best_plain, plain;
+  size_t i;
+  int run, matches;
+
+  for (i = 1; i < (size_t) argc; i++)
+  {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < (size_t) argc)
+    {
+      invaders_seconds = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < (size_t) argc)
+    {
+      synthetic_steps = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < (size_t) argc)
+    {
+      repeats = atoi(argv[++i]);
+    }
+    else
+    {
+      printf("usage: emubench [-s invaders seconds] [-n synthetic steps] [-r repeats]\n");
+      return 1;
+    }
+  }
+  if (repeats < 1)
+  {
+    repeats = 1;
+  }
+
+  perf_fd = open_cache_misses();
+
+  printf("{\n  \"cache_misses_available\": %s,\n  \"benchmarks\": [",
+         perf_fd >= 0 ? "true" : "false");
+
+  for (run = 0; run < repeats; run++)
+  {
+    bench_invaders(&result, invaders_seconds);
+    keep_fastest(&best, &result, run);
+  }
+  print_result("invaders_attract", &best);
+
+  matches = 1;
+  for (run = 0; run < repeats; run++)
+  {
+    bench_lockstep(&result, &plain, invaders_seconds);
+    matches &= result.matches;
+    keep_fastest(&best, &result, run);
+    keep_fastest(&best_plain, &plain, run);
+  }
+  best.matches = matches;
+  print_result("invaders_lanes_scalar", &best_plain);
+  print_result("invaders_lockstep", &best);
+
+  for (run = 0; run < repeats; run++)
+  {
+    bench_cpudiag(&result);
+    keep_fastest(&best, &result, run);
+  }
+  print_result("cpudiag", &best);
+
+  for (i = 0; i < sizeof(synthetic_loops) / sizeof(synthetic_loops[0]); i++)
+  {
+    for (run = 0; run < repeats; run++)
+    {
+      bench_synthetic(&result, &synthetic_loops[i], synthetic_steps);
+      keep_fastest(&best, &result, run);
+    }
+    print_result(synthetic_loops[i].name, &best);
+  }
+
+  printf("\n  ]\n}\n");
+  if (perf_fd >= 0)
+  {
+    close(perf_fd);
+  }
+  return 0;
+}
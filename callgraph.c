@@ -0,0 +1,261 @@
+#include "callgraph.h"
+
+CallGraph* CreateCallGraph(uint16_t root)
+{
+  CallGraph *graph = calloc(1, sizeof(CallGraph));
+
+  graph->nodes[0].entry = root;
+  graph->nodes[0].parent = -1;
+  graph->nodes[0].child = -1;
+  graph->nodes[0].sibling = -1;
+  graph->num_nodes = 1;
+  return graph;
+}
+
+void FreeCallGraph(CallGraph *graph)
+{
+  free(graph);
+}
+
+static inline int32_t current_node(CallGraph *graph)
+{
+  return graph->depth ? graph->stack[graph->depth - 1].node : 0;
+}
+
+// Calling context for `entry` called from `parent`, -1 when the table is full
+static int32_t child_node(CallGraph *graph, int32_t parent, uint16_t entry)
+{
+  int32_t node;
+
+  for (node = graph->nodes[parent].child; node >= 0;
+       node = graph->nodes[node].sibling)
+  {
+    if (graph->nodes[node].entry == entry)
+    {
+      return node;
+    }
+  }
+  if (graph->num_nodes == CALLGRAPH_MAX_NODES)
+  {
+    return -1;
+  }
+
+  node = graph->num_nodes++;
+  graph->nodes[node].entry = entry;
+  graph->nodes[node].parent = parent;
+  graph->nodes[node].child = -1;
+  graph->nodes[node].sibling = graph->nodes[parent].child;
+  graph->nodes[parent].child = node;
+  return node;
+}
+
+/* Open a frame for a call that just jumped to state->pc */
+static void call_push(CallGraph *graph, CpuState *state)
+{
+  int32_t node = -1;
+
+  if (graph->depth < CALLGRAPH_MAX_DEPTH)
+  {
+    node = child_node(graph, current_node(graph), state->pc);
+  }
+  if (node < 0)
+  {
+    graph->overflows++;
+    return;
+  }
+
+  CallFrame *frame = &graph->stack[graph->depth++];
+  frame->node = node;
+  frame->ret = state->memory[state->sp] | (state->memory[state->sp + 1] << 8);
+  frame->sp = state->sp;
+  frame->start = state->cycles;
+
+  graph->calls[state->pc]++;
+  graph->active[state->pc]++;
+}
+
+static void call_pop(CallGraph *graph, uint64_t cycles)
+{
+  CallFrame *frame = &graph->stack[--graph->depth];
+  uint16_t entry = graph->nodes[frame->node].entry;
+
+  //recursive calls are covered by the outermost frame
+  if (--graph->active[entry] == 0)
+  {
+    graph->inclusive[entry] += cycles - frame->start;
+  }
+}
+
+/* A return jumped to state->pc: close frames down to the one it belongs to */
+static void call_return(CallGraph *graph, CpuState *state)
+{
+  int i;
+
+  for (i = graph->depth - 1; i >= 0; i--)
+  {
+    if (graph->stack[i].ret == state->pc)
+    {
+      break;
+    }
+  }
+  if (i < 0)
+  {
+    graph->unmatched++;
+    return;
+  }
+
+  graph->unwinds += graph->depth - 1 - i;
+  while (graph->depth > i)
+  {
+    call_pop(graph, state->cycles);
+  }
+}
+
+static inline int callgraph_before(Machine *machine, CallGraph *graph)
+{
+  CpuState *state = machine->state;
+
+  graph->opcode = state->memory[state->pc];
+  graph->pc = state->pc;
+  graph->sp = state->sp;
+  graph->start = state->cycles;
+  return HOOK_CONTINUE;
+}
+
+static inline int callgraph_after(Machine *machine, CallGraph *graph)
+{
+  CpuState *state = machine->state;
+  uint8_t opcode = graph->opcode;
+
+  graph->nodes[current_node(graph)].cycles += state->cycles - graph->start;
+
+  if ((opcode & 0xcf) == 0xcd || (opcode & 0xc7) == 0xc4 ||
+      (opcode & 0xc7) == 0xc7)
+  {
+    //CALL, Ccc, RST: taken when the return address was pushed
+    if (state->sp == (uint16_t) (graph->sp - 2))
+    {
+      call_push(graph, state);
+    }
+  }
+  else if ((opcode & 0xef) == 0xc9 || (opcode & 0xc7) == 0xc0)
+  {
+    //RET, Rcc
+    if (state->pc != graph->pc + 1)
+    {
+      call_return(graph, state);
+    }
+  }
+
+  //the return address of the top frame was popped without returning
+  while (graph->depth && state->sp > graph->stack[graph->depth - 1].sp)
+  {
+    graph->unwinds++;
+    call_pop(graph, state->cycles);
+  }
+  return HOOK_CONTINUE;
+}
+
+static inline int callgraph_interrupt(Machine *machine, CallGraph *graph)
+{
+  call_push(graph, machine->state);
+  return HOOK_CONTINUE;
+}
+
+DEFINE_MACHINE_RUN_FRAME(MachineRunFrameCallGraph, CallGraph,
+                         callgraph_before, callgraph_after, callgraph_interrupt,
+                         no_machine_limit)
+
+void CallGraphFinish(CallGraph *graph, CpuState *state)
+{
+  while (graph->depth)
+  {
+    call_pop(graph, state->cycles);
+  }
+}
+
+/* Report */
+
+void WriteCollapsedStacks(CallGraph *graph, FILE *out)
+{
+  uint16_t path[CALLGRAPH_MAX_DEPTH + 1];
+  int32_t node;
+
+  for (node = 0; node < graph->num_nodes; node++)
+  {
+    int32_t n;
+    int depth = 0;
+
+    if (graph->nodes[node].cycles == 0)
+    {
+      continue;
+    }
+    for (n = node; n >= 0; n = graph->nodes[n].parent)
+    {
+      path[depth++] = graph->nodes[n].entry;
+    }
+    while (depth--)
+    {
+      fprintf(out, "sub_%04x%c", path[depth], depth ? ';' : ' ');
+    }
+    fprintf(out, "%llu\n", (unsigned long long) graph->nodes[node].cycles);
+  }
+}
+
+typedef struct {
+  uint16_t entry;
+  uint64_t inclusive;
+  uint64_t exclusive;
+} CallSummary;
+
+static int by_inclusive(const void *a, const void *b)
+{
+  uint64_t x = ((const CallSummary *) a)->inclusive;
+  uint64_t y = ((const CallSummary *) b)->inclusive;
+  return (x < y) - (x > y);
+}
+
+void PrintCallGraph(CallGraph *graph, int top)
+{
+  CallSummary *summary = calloc(I8080_MEMORY_SIZE, sizeof(CallSummary));
+  uint64_t total = 0;
+  int32_t node;
+  int count = 0;
+  int i;
+
+  for (i = 0; i < I8080_MEMORY_SIZE; i++)
+  {
+    summary[i].entry = i;
+    summary[i].inclusive = graph->inclusive[i];
+  }
+  for (node = 0; node < graph->num_nodes; node++)
+  {
+    summary[graph->nodes[node].entry].exclusive += graph->nodes[node].cycles;
+    total += graph->nodes[node].cycles;
+  }
+  //the root never returns, it spans the whole run
+  summary[graph->nodes[0].entry].inclusive = total;
+
+  qsort(summary, I8080_MEMORY_SIZE, sizeof(CallSummary), by_inclusive);
+  printf("%-8s %12s %14s %14s %6s\n", "sub", "calls", "inclusive", "exclusive",
+         "share");
+  for (i = 0; i < I8080_MEMORY_SIZE && count < top; i++)
+  {
+    if (summary[i].inclusive == 0)
+    {
+      break;
+    }
+    printf("sub_%04x %12llu %14llu %14llu %5.1f%%\n", summary[i].entry,
+           (unsigned long long) graph->calls[summary[i].entry],
+           (unsigned long long) summary[i].inclusive,
+           (unsigned long long) summary[i].exclusive,
+           total ? 100.0 * summary[i].inclusive / total : 0.0);
+    count++;
+  }
+  printf("%d calling contexts, %llu unwinds, %llu unmatched returns, "
+         "%llu dropped calls\n", graph->num_nodes,
+         (unsigned long long) graph->unwinds,
+         (unsigned long long) graph->unmatched,
+         (unsigned long long) graph->overflows);
+  free(summary);
+}
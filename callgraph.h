@@ -0,0 +1,78 @@
+#ifndef I8080_CALLGRAPH_H
+#define I8080_CALLGRAPH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// Call graph profile from a shadow call stack.
+//
+// CALL, taken Ccc, RST and interrupts push a frame, RET and Rcc pop back to
+// the frame whose return address they jumped to. Code that drops its return
+// address (POP then JMP, or resetting SP) is noticed when SP moves above a
+// frame, which is then closed as an unwind. Returns that match no frame,
+// like RET used as a computed jump, leave the stack alone.
+//
+// Every instruction's cycles go to the calling context on top of the stack,
+// which gives exclusive cycles and collapsed stacks; inclusive cycles are
+// taken when a frame closes and counted once for recursive subroutines.
+
+#define CALLGRAPH_MAX_DEPTH 256
+#define CALLGRAPH_MAX_NODES 65536
+
+typedef struct {
+  uint16_t entry;         // subroutine address
+  int32_t  parent;
+  int32_t  child;         // first callee
+  int32_t  sibling;       // next callee of the parent
+  uint64_t cycles;        // exclusive cycles in this calling context
+} CallNode;
+
+typedef struct {
+  int32_t  node;
+  uint16_t ret;           // address pushed by the call
+  uint16_t sp;            // SP right after the call, return address is here
+  uint64_t start;         // cycle count at entry
+} CallFrame;
+
+typedef struct {
+  // per subroutine entry address
+  uint64_t calls[I8080_MEMORY_SIZE];
+  uint64_t inclusive[I8080_MEMORY_SIZE];
+  uint16_t active[I8080_MEMORY_SIZE];   // frames open on the stack
+
+  CallNode  nodes[CALLGRAPH_MAX_NODES];
+  int       num_nodes;
+  CallFrame stack[CALLGRAPH_MAX_DEPTH];
+  int       depth;
+
+  // instruction in flight
+  uint8_t  opcode;
+  uint16_t pc;
+  uint16_t sp;
+  uint64_t start;
+
+  uint64_t unwinds;       // frames closed by SP instead of a return
+  uint64_t unmatched;     // returns that matched no frame
+  uint64_t overflows;     // calls dropped on a full stack or node table
+} CallGraph;
+
+// root: address execution starts at, named as the bottom of every stack
+CallGraph* CreateCallGraph(uint16_t root);
+void FreeCallGraph(CallGraph *graph);
+
+// MachineRunFrame, tracking calls and returns into the graph.
+int MachineRunFrameCallGraph(Machine *machine, CallGraph *graph);
+
+// Close open frames, as if everything returned at the current cycle count.
+void CallGraphFinish(CallGraph *graph, CpuState *state);
+
+// Write one "root;caller;callee cycles" line per calling context, the
+// collapsed stack format flamegraph.pl and speedscope read.
+void WriteCollapsedStacks(CallGraph *graph, FILE *out);
+
+// Print the `top` subroutines by inclusive cycles.
+void PrintCallGraph(CallGraph *graph, int top);
+
+#endif /* I8080_CALLGRAPH_H */
@@ -0,0 +1,441 @@
+#include "cfg.h"
+#include "disassembler.h"
+
+// How an instruction passes control on
+enum {
+  FLOW_NEXT = 0,    // straight on
+  FLOW_JUMP,        // JMP
+  FLOW_BRANCH,      // Jcc
+  FLOW_CALL,        // CALL, Ccc
+  FLOW_RST,
+  FLOW_RETURN_IF,   // Rcc
+  FLOW_STOP,        // RET, PCHL, HLT
+};
+
+static int flow_of(uint8_t opcode)
+{
+  switch (opcode & 0xc7)
+  {
+    case 0xc0: return FLOW_RETURN_IF;
+    case 0xc2: return FLOW_BRANCH;
+    case 0xc4: return FLOW_CALL;
+    case 0xc7: return FLOW_RST;
+  }
+  switch (opcode)
+  {
+    case 0xc3: return FLOW_JUMP;
+    case 0xcd: return FLOW_CALL;
+    case 0xc9:
+    case 0xe9:
+    case 0x76: return FLOW_STOP;
+  }
+  return FLOW_NEXT;
+}
+
+static uint16_t target_of(const uint8_t *code)
+{
+  if ((code[0] & 0xc7) == 0xc7)
+  {
+    return code[0] & 0x38;
+  }
+  return (code[2] << 8) | code[1];
+}
+
+/* Mark `addr` as a block start reached with `flag`, 1 if it is in the image */
+static int add_target(Cfg *cfg, uint32_t addr, uint8_t flag)
+{
+  if (addr >= cfg->size)
+  {
+    cfg->external++;
+    return 0;
+  }
+  cfg->flags[addr] |= CFG_LEADER | flag;
+  return 1;
+}
+
+/* First pass: mark every instruction reachable from the worklist */
+static void decode(Cfg *cfg, uint16_t *work, int count)
+{
+  const uint8_t *memory = cfg->memory;
+  uint8_t *flags = cfg->flags;
+
+  while (count > 0)
+  {
+    uint32_t addr = work[--count];
+
+    //each pass of the loop decodes one instruction, until the path ends
+    while (addr < cfg->size && !(flags[addr] & CFG_CODE))
+    {
+      const uint8_t *code = &memory[addr];
+      int length = Length8080Op(code[0]);
+      int i;
+
+      if (addr + length > cfg->size)
+      {
+        cfg->external++;
+        break;
+      }
+      for (i = 0; i < length && !(flags[addr + i] & (CFG_CODE | CFG_OPERAND)); i++)
+        ;
+      if (i < length)
+      {
+        cfg->overlaps++;
+        break;
+      }
+      flags[addr] |= CFG_CODE;
+      for (i = 1; i < length; i++)
+      {
+        flags[addr + i] |= CFG_OPERAND;
+      }
+      cfg->instructions++;
+      cfg->code_bytes += length;
+
+      uint32_t next = addr + length;
+      int flow = flow_of(code[0]);
+      if (flow == FLOW_JUMP || flow == FLOW_BRANCH)
+      {
+        if (add_target(cfg, target_of(code), CFG_JUMPED))
+        {
+          work[count++] = target_of(code);
+        }
+      }
+      else if (flow == FLOW_CALL || flow == FLOW_RST)
+      {
+        if (add_target(cfg, target_of(code), CFG_CALLED))
+        {
+          work[count++] = target_of(code);
+        }
+      }
+      else if (code[0] == 0xe9)
+      {
+        cfg->indirect++;
+      }
+
+      if (flow == FLOW_JUMP || flow == FLOW_STOP)
+      {
+        break;
+      }
+      if (flow != FLOW_NEXT && next < cfg->size)
+      {
+        flags[next] |= CFG_LEADER;
+      }
+      addr = next;
+    }
+  }
+}
+
+static void add_edge(Cfg *cfg, uint16_t from, uint32_t to, uint8_t kind)
+{
+  if (to < cfg->size)
+  {
+    CfgEdge *edge = &cfg->edges[cfg->num_edges++];
+    edge->from = from;
+    edge->to = to;
+    edge->kind = kind;
+  }
+}
+
+/* Edges out of a block, from how its last instruction at `last` ends it */
+static void add_block_edges(Cfg *cfg, CfgBlock *block, uint16_t last)
+{
+  const uint8_t *code = &cfg->memory[last];
+  int flow = flow_of(code[0]);
+
+  block->first_edge = cfg->num_edges;
+  switch (flow)
+  {
+    case FLOW_JUMP:
+      add_edge(cfg, last, target_of(code), CFG_EDGE_JUMP);
+      break;
+    case FLOW_BRANCH:
+      add_edge(cfg, last, target_of(code), CFG_EDGE_JUMP);
+      add_edge(cfg, last, block->end, CFG_EDGE_FALL);
+      break;
+    case FLOW_CALL:
+    case FLOW_RST:
+      add_edge(cfg, last, target_of(code), CFG_EDGE_CALL);
+      add_edge(cfg, last, block->end, CFG_EDGE_FALL);
+      break;
+    case FLOW_STOP:
+      break;
+    default:
+      //Rcc, or a block cut short by a jump target
+      if (block->end < cfg->size && (cfg->flags[block->end] & CFG_CODE))
+      {
+        add_edge(cfg, last, block->end, CFG_EDGE_FALL);
+      }
+      break;
+  }
+  block->num_edges = cfg->num_edges - block->first_edge;
+}
+
+/* Second pass: cut the decoded instructions into blocks */
+static void split_blocks(Cfg *cfg)
+{
+  const uint8_t *flags = cfg->flags;
+  CfgBlock *block = NULL;
+  uint32_t addr = 0;
+  uint16_t last = 0;
+
+  cfg->blocks = malloc((cfg->instructions + 1) * sizeof(CfgBlock));
+  cfg->edges = malloc((2 * cfg->instructions + 1) * sizeof(CfgEdge));
+  while (addr < cfg->size)
+  {
+    if (!(flags[addr] & CFG_CODE))
+    {
+      if (block)
+      {
+        add_block_edges(cfg, block, last);
+        block = NULL;
+      }
+      addr++;
+      continue;
+    }
+    if (block && (flags[addr] & CFG_LEADER))
+    {
+      add_block_edges(cfg, block, last);
+      block = NULL;
+    }
+    if (block == NULL)
+    {
+      block = &cfg->blocks[cfg->num_blocks++];
+      memset(block, 0, sizeof(CfgBlock));
+      block->start = addr;
+    }
+
+    uint8_t opcode = cfg->memory[addr];
+    last = addr;
+    addr += Length8080Op(opcode);
+    block->end = addr;
+    block->instructions++;
+    block->cycles += opcodes8080[opcode].cycles;
+    if (flow_of(opcode) != FLOW_NEXT)
+    {
+      add_block_edges(cfg, block, last);
+      block = NULL;
+    }
+  }
+  if (block)
+  {
+    add_block_edges(cfg, block, last);
+  }
+}
+
+static int by_target(const void *a, const void *b)
+{
+  const CfgEdge *x = a, *y = b;
+
+  if (x->to != y->to)
+  {
+    return x->to - y->to;
+  }
+  return x->from - y->from;
+}
+
+static void collect_xrefs(Cfg *cfg)
+{
+  int i;
+
+  cfg->xrefs = malloc((cfg->num_edges + 1) * sizeof(CfgEdge));
+  for (i = 0; i < cfg->num_edges; i++)
+  {
+    if (cfg->edges[i].kind != CFG_EDGE_FALL)
+    {
+      cfg->xrefs[cfg->num_xrefs++] = cfg->edges[i];
+    }
+  }
+  qsort(cfg->xrefs, cfg->num_xrefs, sizeof(CfgEdge), by_target);
+}
+
+Cfg* BuildCfg(const uint8_t *memory, uint32_t size,
+              const uint16_t *entries, int num_entries)
+{
+  Cfg *cfg = calloc(1, sizeof(Cfg));
+  //every instruction pushes at most one target, on top of the entries
+  uint16_t *work = malloc((I8080_MEMORY_SIZE + 8 + num_entries) * sizeof(uint16_t));
+  int count = 0;
+  int i;
+
+  cfg->memory = memory;
+  cfg->size = size < I8080_MEMORY_SIZE ? size : I8080_MEMORY_SIZE;
+
+  //pushed last so the reset vector is decoded first
+  for (i = num_entries - 1; i >= 0; i--)
+  {
+    if (add_target(cfg, entries[i], CFG_CALLED))
+    {
+      work[count++] = entries[i];
+    }
+  }
+  for (i = 7; i >= 0; i--)
+  {
+    if (add_target(cfg, i * 8, CFG_CALLED))
+    {
+      work[count++] = i * 8;
+    }
+  }
+  cfg->entries = count;
+
+  decode(cfg, work, count);
+  free(work);
+  split_blocks(cfg);
+  collect_xrefs(cfg);
+  return cfg;
+}
+
+void FreeCfg(Cfg *cfg)
+{
+  free(cfg->blocks);
+  free(cfg->edges);
+  free(cfg->xrefs);
+  free(cfg);
+}
+
+const CfgBlock* FindCfgBlock(const Cfg *cfg, uint16_t addr)
+{
+  int low = 0, high = cfg->num_blocks;
+
+  //first block starting after addr, the one before may hold it
+  while (low < high)
+  {
+    int mid = (low + high) / 2;
+    if (cfg->blocks[mid].start <= addr)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  if (low > 0 && addr < cfg->blocks[low - 1].end)
+  {
+    return &cfg->blocks[low - 1];
+  }
+  return NULL;
+}
+
+/* Label line of a jump or call target, with where it is reached from */
+static void print_label(const Cfg *cfg, uint16_t addr, FILE *out)
+{
+  const CfgEdge *xref = cfg->xrefs;
+  int low = 0, high = cfg->num_xrefs;
+  int shown = 0;
+
+  while (low < high)
+  {
+    int mid = (low + high) / 2;
+    if (xref[mid].to < addr)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  fprintf(out, "\n%s_%04x:", (cfg->flags[addr] & CFG_CALLED) ? "sub" : "loc", addr);
+  for (; low < cfg->num_xrefs && xref[low].to == addr; low++, shown++)
+  {
+    if (shown == 8)
+    {
+      int more = 0;
+      for (; low < cfg->num_xrefs && xref[low].to == addr; low++)
+      {
+        more++;
+      }
+      fprintf(out, " +%d", more);
+      break;
+    }
+    fprintf(out, "%s $%04x", shown ? "" : "    ; from", xref[low].from);
+  }
+  fprintf(out, "\n");
+}
+
+/* DB lines for the data in [addr, end), 8 bytes a line */
+static void print_data(const Cfg *cfg, uint32_t addr, uint32_t end, FILE *out)
+{
+  while (addr < end)
+  {
+    uint32_t stop = (addr + 8 < end) ? addr + 8 : end;
+    fprintf(out, "%05x DB     ", addr);
+    for (; addr < stop; addr++)
+    {
+      fprintf(out, "$%02x%s", cfg->memory[addr], addr + 1 < stop ? "," : "\n");
+    }
+  }
+}
+
+void PrintCfgListing(const Cfg *cfg, FILE *out)
+{
+  static char lines[1 << 16];
+  uint32_t addr = 0;
+  int b;
+
+  fprintf(out, "; %d entries, %d blocks, %d edges, %u instructions, "
+          "%u of %u bytes code\n", cfg->entries, cfg->num_blocks,
+          cfg->num_edges, cfg->instructions, cfg->code_bytes, cfg->size);
+  fprintf(out, "; %d overlaps, %d targets outside the image, %d PCHL\n",
+          cfg->overlaps, cfg->external, cfg->indirect);
+
+  for (b = 0; b <= cfg->num_blocks; b++)
+  {
+    uint32_t start = b < cfg->num_blocks ? cfg->blocks[b].start : cfg->size;
+    if (addr < start)
+    {
+      print_data(cfg, addr, start, out);
+    }
+    if (b == cfg->num_blocks)
+    {
+      break;
+    }
+
+    const CfgBlock *block = &cfg->blocks[b];
+    if (cfg->flags[block->start] & (CFG_CALLED | CFG_JUMPED))
+    {
+      print_label(cfg, block->start, out);
+    }
+    addr = block->start;
+    while (addr < block->end)
+    {
+      size_t length = Disassemble8080Range(cfg->memory, &addr, block->end,
+                                           lines, sizeof(lines));
+      fwrite(lines, 1, length, out);
+    }
+  }
+}
+
+void WriteCfgDot(const Cfg *cfg, FILE *out)
+{
+  int b, e;
+
+  fprintf(out, "digraph cfg {\n");
+  fprintf(out, "  node [shape=box, fontname=monospace];\n");
+  for (b = 0; b < cfg->num_blocks; b++)
+  {
+    const CfgBlock *block = &cfg->blocks[b];
+    uint8_t flags = cfg->flags[block->start];
+    fprintf(out, "  a%04x [label=\"%s%04x..%04x\\n%u instructions, %u cycles\"];\n",
+            block->start,
+            (flags & CFG_CALLED) ? "sub " : (flags & CFG_JUMPED) ? "loc " : "",
+            block->start, block->end - 1, block->instructions, block->cycles);
+  }
+  for (b = 0; b < cfg->num_blocks; b++)
+  {
+    const CfgBlock *block = &cfg->blocks[b];
+    for (e = block->first_edge; e < block->first_edge + block->num_edges; e++)
+    {
+      const CfgEdge *edge = &cfg->edges[e];
+      //a target clashing with decoded bytes has no block of its own
+      if (!(cfg->flags[edge->to] & CFG_CODE))
+      {
+        continue;
+      }
+      fprintf(out, "  a%04x -> a%04x%s;\n", block->start, edge->to,
+              edge->kind == CFG_EDGE_CALL ? " [style=dashed]" :
+              edge->kind == CFG_EDGE_FALL ? " [color=gray]" : "");
+    }
+  }
+  fprintf(out, "}\n");
+}
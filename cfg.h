@@ -0,0 +1,88 @@
+#ifndef I8080_CFG_H
+#define I8080_CFG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+// Control flow graph of a memory image, by recursive descent.
+//
+// Decoding starts at the reset and RST vectors and any extra entry points,
+// and follows JMP, Jcc, CALL, Ccc and RST targets from a worklist, so data
+// tables between routines are never decoded as code. Jumps through PCHL and
+// returns used as jumps are not followed; code only reached that way is
+// left as data. An instruction that would overlap one already decoded is
+// counted and its path dropped.
+//
+// Blocks end like the profiler's: at any jump, call, return, RST, PCHL or
+// HLT, or where a jump lands. They are sorted by address, so FindCfgBlock
+// is a binary search and the whole map can be handed to anything that
+// wants the block boundaries before running the code.
+
+// per address flags
+#define CFG_CODE     0x01   // first byte of an instruction
+#define CFG_OPERAND  0x02   // later byte of an instruction
+#define CFG_LEADER   0x04   // a block starts here
+#define CFG_CALLED   0x08   // CALL, Ccc or RST target, or an entry point
+#define CFG_JUMPED   0x10   // JMP or Jcc target
+
+// edge kinds
+#define CFG_EDGE_FALL 0     // on to the next instruction, or back from a call
+#define CFG_EDGE_JUMP 1     // JMP, or Jcc taken
+#define CFG_EDGE_CALL 2     // CALL, Ccc taken, or RST
+
+#define CFG_MAX_ENTRIES 64
+
+typedef struct {
+  uint16_t from;          // address of the last instruction of the block
+  uint16_t to;
+  uint8_t  kind;          // CFG_EDGE_*
+} CfgEdge;
+
+typedef struct {
+  uint16_t start;
+  uint32_t end;           // address after the last instruction
+  uint16_t instructions;
+  uint32_t cycles;        // not-taken cycles of all its instructions
+  int32_t  first_edge;    // edges[first_edge..first_edge + num_edges)
+  uint8_t  num_edges;
+} CfgBlock;
+
+typedef struct {
+  const uint8_t *memory;
+  uint32_t size;          // code is decoded in [0, size)
+  uint8_t  flags[I8080_MEMORY_SIZE];
+
+  CfgBlock *blocks;       // by start address
+  int      num_blocks;
+  CfgEdge  *edges;        // by block
+  int      num_edges;
+  CfgEdge  *xrefs;        // jump and call edges by target, then source
+  int      num_xrefs;
+
+  int      entries;
+  uint32_t instructions;
+  uint32_t code_bytes;
+  int      overlaps;      // paths dropped on a clash with decoded bytes
+  int      external;      // targets outside [0, size)
+  int      indirect;      // PCHL
+} Cfg;
+
+// Decode `memory` from address 0 to `size`, starting at the reset and RST
+// vectors and `num_entries` more entry points.
+Cfg* BuildCfg(const uint8_t *memory, uint32_t size,
+              const uint16_t *entries, int num_entries);
+void FreeCfg(Cfg *cfg);
+
+// Block holding `addr`, NULL if it was not decoded as code.
+const CfgBlock* FindCfgBlock(const Cfg *cfg, uint16_t addr);
+
+// Listing of the whole image: blocks under their labels with the addresses
+// that jump or call there, and data left as DB lines.
+void PrintCfgListing(const Cfg *cfg, FILE *out);
+
+// The blocks and edges as a graphviz digraph.
+void WriteCfgDot(const Cfg *cfg, FILE *out);
+
+#endif /* I8080_CFG_H */
@@ -0,0 +1,128 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+CounterPublisher* CreateCounterPublisher(const char *name)
+{
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(SharedCounters)) != 0)
+  {
+    printf("error: cannot create shared memory %s\n", name);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return NULL;
+  }
+  SharedCounters *shared = mmap(NULL, sizeof(SharedCounters),
+                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED)
+  {
+    printf("error: cannot map shared memory %s\n", name);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  CounterPublisher *publisher = calloc(1, sizeof(CounterPublisher));
+  publisher->name = strdup(name);
+  publisher->shared = shared;
+  publisher->start_ns = now_ns();
+  publisher->window_ns = publisher->start_ns;
+
+  memset(shared, 0, sizeof(SharedCounters));
+  shared->magic = COUNTERS_MAGIC;
+  shared->version = COUNTERS_VERSION;
+  shared->pid = getpid();
+  return publisher;
+}
+
+void FreeCounterPublisher(CounterPublisher *publisher)
+{
+  munmap(publisher->shared, sizeof(SharedCounters));
+  shm_unlink(publisher->name);
+  free(publisher->name);
+  free(publisher);
+}
+
+void PublishCounters(CounterPublisher *publisher, Machine *machine)
+{
+  SharedCounters *shared = publisher->shared;
+  CpuState *state = machine->state;
+  uint64_t now = now_ns();
+  unsigned seq = atomic_load_explicit(&shared->seq, memory_order_relaxed);
+
+  //odd while the fields are being written
+  atomic_store_explicit(&shared->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  shared->instructions = machine->instructions;
+  shared->cycles = state->cycles;
+  shared->interrupts = machine->interrupts;
+  shared->frames = machine->frames;
+  shared->unimplemented = state->halted;
+  shared->elapsed_ns = now - publisher->start_ns;
+  if (now - publisher->window_ns >= 1000000000)
+  {
+    double emulated = (double) (state->cycles - publisher->window_cycles) / MACHINE_CLOCK_HZ;
+    shared->speed = emulated / ((now - publisher->window_ns) * 1e-9);
+    publisher->window_ns = now;
+    publisher->window_cycles = state->cycles;
+  }
+
+  atomic_store_explicit(&shared->seq, seq + 2, memory_order_release);
+}
+
+const SharedCounters* OpenCounters(const char *name)
+{
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    printf("error: no counters at %s\n", name);
+    return NULL;
+  }
+  SharedCounters *shared = mmap(NULL, sizeof(SharedCounters), PROT_READ,
+                                MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED || shared->magic != COUNTERS_MAGIC ||
+      shared->version != COUNTERS_VERSION)
+  {
+    printf("error: %s is not a counter segment of this version\n", name);
+    if (shared != MAP_FAILED)
+    {
+      munmap(shared, sizeof(SharedCounters));
+    }
+    return NULL;
+  }
+  return shared;
+}
+
+void CloseCounters(const SharedCounters *shared)
+{
+  munmap((void*) shared, sizeof(SharedCounters));
+}
+
+void ReadCounters(const SharedCounters *shared, SharedCounters *snapshot)
+{
+  SharedCounters *s = (SharedCounters*) shared;
+  unsigned before, after;
+
+  do
+  {
+    before = atomic_load_explicit(&s->seq, memory_order_acquire);
+    memcpy(snapshot, shared, sizeof(SharedCounters));
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&s->seq, memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
@@ -0,0 +1,62 @@
+#ifndef I8080_COUNTERS_H
+#define I8080_COUNTERS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// Runtime counters published in a POSIX shared memory segment.
+//
+// The emulator copies its counters in once per frame under a seqlock: the
+// sequence number is odd while an update is in progress. Readers never
+// block the emulator; ReadCounters retries until it copies a snapshot
+// taken between two updates.
+//
+// There is no block cache in this emulator, so there are no hit or miss
+// counters. The core stops the cpu at the first unimplemented opcode, so
+// `unimplemented` is 0 or 1.
+
+#define COUNTERS_MAGIC   0x30383038   // "8080"
+#define COUNTERS_VERSION 1
+#define COUNTERS_NAME    "/i8080-counters"
+
+typedef struct {
+  uint32_t    magic;
+  uint32_t    version;
+  atomic_uint seq;
+  uint32_t    pid;
+
+  uint64_t instructions;
+  uint64_t cycles;
+  uint64_t interrupts;     // delivered, not requested while disabled
+  uint64_t frames;
+  uint64_t unimplemented;
+  uint64_t elapsed_ns;     // real time since publishing started
+  double   speed;          // emulated / real time over the last second
+} SharedCounters;
+
+typedef struct {
+  char           *name;
+  SharedCounters *shared;
+  uint64_t       start_ns;
+  uint64_t       window_ns;      // start of the speed window
+  uint64_t       window_cycles;
+} CounterPublisher;
+
+// Create and map the segment `name` (like COUNTERS_NAME), NULL on error.
+CounterPublisher* CreateCounterPublisher(const char *name);
+// Unmap and remove the segment.
+void FreeCounterPublisher(CounterPublisher *publisher);
+
+// Copy the machine's counters into the segment, once per frame.
+void PublishCounters(CounterPublisher *publisher, Machine *machine);
+
+// Map a published segment read only, NULL with a message on error.
+const SharedCounters* OpenCounters(const char *name);
+void CloseCounters(const SharedCounters *shared);
+
+// Consistent copy of the counters.
+void ReadCounters(const SharedCounters *shared, SharedCounters *snapshot);
+
+#endif /* I8080_COUNTERS_H */
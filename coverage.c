@@ -0,0 +1,264 @@
+#include "coverage.h"
+#include "access.h"
+#include "disassembler.h"
+
+// Instructions disassembled per never executed range
+#define COVERAGE_DISASM 4
+
+// What the hook does per opcode beyond setting the exec bit: conditional
+// branches record their direction, reads record the bytes at an address
+// taken from one of the register pairs or the instruction
+#define KIND_BRANCH     0x01
+#define KIND_TWO_BYTES  0x02
+#define KIND_SOURCE     0x1c
+#define SOURCE_HL       0x04
+#define SOURCE_BC       0x08
+#define SOURCE_DE       0x0c
+#define SOURCE_SP       0x10
+#define SOURCE_DIRECT   0x14
+
+static uint8_t opcode_kinds[256];
+
+// Classify every opcode once by asking the access decoder, with every
+// register pair holding a different address so the one it read from shows,
+// under both settings of the flags so every condition holds in one of them
+static void init_opcode_kinds(void)
+{
+  static uint8_t memory[I8080_MEMORY_SIZE];
+  static const struct {
+    uint16_t addr;
+    uint8_t  source;
+  } sources[] = {
+    {0x1111, SOURCE_HL}, {0x2222, SOURCE_BC}, {0x3333, SOURCE_DE},
+    {0x4444, SOURCE_SP}, {0x5555, SOURCE_DIRECT},
+  };
+  CpuState state;
+  MemoryAccess access;
+  int opcode, flags, i;
+
+  memset(&state, 0, sizeof(state));
+  state.memory = memory;
+  state.h = state.l = 0x11;
+  state.b = state.c = 0x22;
+  state.d = state.e = 0x33;
+  state.sp = 0x4444;
+  memory[1] = memory[2] = 0x55;
+  for (opcode = 0; opcode < 256; opcode++)
+  {
+    uint8_t kinds = 0;
+    switch (opcode & 0xc7)
+    {
+      case 0xc0:  //Rcc
+      case 0xc2:  //Jcc
+      case 0xc4:  //Ccc
+        kinds |= KIND_BRANCH;
+        break;
+    }
+    memory[0] = opcode;
+    for (flags = 0; flags <= 1; flags++)
+    {
+      state.cc.z = state.cc.cy = state.cc.p = state.cc.s = flags;
+      if (!DecodeMemoryAccess(&state, &access) || !(access.kind & ACCESS_READ))
+      {
+        continue;
+      }
+      for (i = 0; i < sizeof(sources) / sizeof(sources[0]); i++)
+      {
+        if (access.addr == sources[i].addr)
+        {
+          kinds |= sources[i].source;
+        }
+      }
+      if (access.size == 2)
+      {
+        kinds |= KIND_TWO_BYTES;
+      }
+    }
+    opcode_kinds[opcode] = kinds;
+  }
+}
+
+Coverage* CreateCoverage(void)
+{
+  if (opcode_kinds[0xc0] == 0)
+  {
+    init_opcode_kinds();
+  }
+  return calloc(1, sizeof(Coverage));
+}
+
+void FreeCoverage(Coverage *coverage)
+{
+  free(coverage);
+}
+
+static inline void set_bit(uint64_t *bits, uint16_t addr)
+{
+  bits[addr >> 6] |= 1ULL << (addr & 63);
+}
+
+static inline int get_bit(const uint64_t *bits, uint16_t addr)
+{
+  return (bits[addr >> 6] >> (addr & 63)) & 1;
+}
+
+static inline int coverage_before(Machine *machine, Coverage *coverage)
+{
+  CpuState *state = machine->state;
+  uint16_t pc = state->pc;
+  uint8_t opcode = state->memory[pc];
+  uint8_t kinds = opcode_kinds[opcode];
+  uint16_t addr;
+
+  set_bit(coverage->exec, pc);
+  if (kinds == 0)
+  {
+    return HOOK_CONTINUE;
+  }
+  if (kinds & KIND_BRANCH)
+  {
+    //only a return reads, and only when it is taken
+    int taken = ConditionHolds(state, opcode);
+    set_bit(taken ? coverage->taken : coverage->not_taken, pc);
+    if (!taken)
+    {
+      return HOOK_CONTINUE;
+    }
+  }
+  switch (kinds & KIND_SOURCE)
+  {
+    case SOURCE_HL:
+      addr = (state->h << 8) | state->l;
+      break;
+    case SOURCE_BC:
+      addr = (state->b << 8) | state->c;
+      break;
+    case SOURCE_DE:
+      addr = (state->d << 8) | state->e;
+      break;
+    case SOURCE_SP:
+      addr = state->sp;
+      break;
+    case SOURCE_DIRECT:
+      addr = state->memory[(uint16_t) (pc + 1)] |
+             (state->memory[(uint16_t) (pc + 2)] << 8);
+      break;
+    default:
+      return HOOK_CONTINUE;
+  }
+  set_bit(coverage->read, addr);
+  if (kinds & KIND_TWO_BYTES)
+  {
+    set_bit(coverage->read, addr + 1);
+  }
+  return HOOK_CONTINUE;
+}
+
+DEFINE_MACHINE_RUN_FRAME(MachineRunFrameCoverage, Coverage,
+                         coverage_before, no_machine_hook, no_machine_hook,
+                         no_machine_limit)
+
+void MergeCoverage(Coverage *into, const Coverage *from)
+{
+  int i;
+
+  for (i = 0; i < COVERAGE_WORDS; i++)
+  {
+    into->exec[i] |= from->exec[i];
+    into->read[i] |= from->read[i];
+    into->taken[i] |= from->taken[i];
+    into->not_taken[i] |= from->not_taken[i];
+  }
+}
+
+static double percent(uint32_t part, uint32_t whole)
+{
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+void PrintCoverage(const Coverage *coverage, uint8_t *memory,
+                   uint32_t start, uint32_t end)
+{
+  uint8_t *code = calloc(I8080_MEMORY_SIZE, 1);   // part of an executed instruction
+  uint32_t size = end - start;
+  uint32_t opcodes = 0, executed = 0, data = 0, touched = 0;
+  uint32_t branches = 0, both = 0, taken_only = 0, not_taken_only = 0;
+  uint32_t addr, i;
+
+  for (addr = start; addr < end; addr++)
+  {
+    if (!get_bit(coverage->exec, addr))
+    {
+      continue;
+    }
+    opcodes++;
+    for (i = 0; i < Length8080Op(memory[addr]) && addr + i < I8080_MEMORY_SIZE; i++)
+    {
+      code[addr + i] = 1;
+    }
+
+    int taken = get_bit(coverage->taken, addr);
+    int not_taken = get_bit(coverage->not_taken, addr);
+    if (taken || not_taken)
+    {
+      branches++;
+      both += taken && not_taken;
+      taken_only += taken && !not_taken;
+      not_taken_only += not_taken && !taken;
+    }
+  }
+  for (addr = start; addr < end; addr++)
+  {
+    executed += code[addr];
+    data += get_bit(coverage->read, addr);
+    touched += code[addr] || get_bit(coverage->read, addr);
+  }
+
+  printf("coverage of $%04x-$%04x:\n", start, end - 1);
+  printf("  executed %6u bytes %5.1f%%, %u instructions\n",
+         executed, percent(executed, size), opcodes);
+  printf("  read     %6u bytes %5.1f%%\n", data, percent(data, size));
+  printf("  touched  %6u bytes %5.1f%%\n", touched, percent(touched, size));
+  printf("  branches %6u, both ways %u %.1f%%, only taken %u, only not taken %u\n",
+         branches, both, percent(both, branches), taken_only, not_taken_only);
+
+  // Unexecuted ranges read as data are most likely tables; disassemble the
+  // start of the others
+  printf("\nnever executed:\n");
+  addr = start;
+  while (addr < end)
+  {
+    if (code[addr])
+    {
+      addr++;
+      continue;
+    }
+
+    uint32_t first = addr;
+    uint32_t reads = 0;
+    while (addr < end && !code[addr])
+    {
+      reads += get_bit(coverage->read, addr);
+      addr++;
+    }
+    printf("$%04x-$%04x %5u bytes", first, addr - 1, addr - first);
+    if (reads)
+    {
+      printf(", %u read as data\n", reads);
+      continue;
+    }
+    printf("\n");
+
+    uint32_t pc = first;
+    for (i = 0; i < COVERAGE_DISASM && pc < addr; i++)
+    {
+      printf("    ");
+      pc += Disassemble8080Op(memory, pc);
+    }
+    if (pc < addr)
+    {
+      printf("    ...\n");
+    }
+  }
+  free(code);
+}
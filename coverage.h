@@ -0,0 +1,42 @@
+#ifndef I8080_COVERAGE_H
+#define I8080_COVERAGE_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+// Code coverage: one bit per address for each of
+//   exec       an instruction started here
+//   read       read as data
+//   taken      a conditional jump, call or return here had its condition hold
+//   not_taken  ... and fail
+// 32KB per machine, so every machine in a fleet can keep its own and the
+// maps are ORed together afterwards.
+//
+// Recording lives in MachineRunFrameCoverage; RunFleet uses it for machines
+// with machine->coverage set.
+
+#define COVERAGE_WORDS (I8080_MEMORY_SIZE / 64)
+
+struct Coverage {
+  uint64_t exec[COVERAGE_WORDS];
+  uint64_t read[COVERAGE_WORDS];
+  uint64_t taken[COVERAGE_WORDS];
+  uint64_t not_taken[COVERAGE_WORDS];
+};
+
+Coverage* CreateCoverage(void);
+void FreeCoverage(Coverage *coverage);
+
+// MachineRunFrame, recording coverage.
+int MachineRunFrameCoverage(Machine *machine, Coverage *coverage);
+
+// OR the bits of `from` into `into`.
+void MergeCoverage(Coverage *into, const Coverage *from);
+
+// Print coverage of [start, end): executed and data bytes, branches taken
+// both ways, and the ranges never executed, disassembled from `memory`.
+void PrintCoverage(const Coverage *coverage, uint8_t *memory,
+                   uint32_t start, uint32_t end);
+
+#endif /* I8080_COVERAGE_H */
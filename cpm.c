@@ -0,0 +1,200 @@
+#include <strings.h>
+
+#include "cpm.h"
+#include "runloop.h"
+
+/* Console output */
+static void cpm_putc(CpmMachine *cpm, char c)
+{
+  if (cpm->buffered == CPM_BUFFER_SIZE)
+  {
+    CpmFlush(cpm);
+  }
+  cpm->buffer[cpm->buffered++] = c;
+}
+
+void CpmFlush(CpmMachine *cpm)
+{
+  fwrite(cpm->buffer, 1, cpm->buffered, cpm->out);
+  fflush(cpm->out);
+  cpm->buffered = 0;
+}
+
+/* Return from a trapped CALL */
+static void cpm_return(CpuState *state)
+{
+  state->pc = state->memory[state->sp] | (state->memory[(uint16_t) (state->sp + 1)] << 8);
+  state->sp += 2;
+  state->cycles += 10;
+}
+
+static int warm_boot_trap(CpmMachine *cpm)
+{
+  cpm->warm_boot = 1;
+  CpmFlush(cpm);
+  return HOOK_STOP;
+}
+
+static int bdos_trap(CpmMachine *cpm)
+{
+  CpuState *state = cpm->state;
+
+  switch (state->c)
+  {
+    case 0: //system reset
+      return warm_boot_trap(cpm);
+
+    case 2: //console output, char in E
+      cpm_putc(cpm, state->e);
+      break;
+
+    case 9: //print string at DE up to '$'
+      {
+      uint16_t offset = (state->d << 8) | (state->e);
+      uint32_t n;
+      //a string with no '$' stops after going once round memory
+      for (n = 0; n < I8080_MEMORY_SIZE && state->memory[offset] != '$'; n++)
+      {
+        cpm_putc(cpm, state->memory[offset++]);
+      }
+      }
+      break;
+
+    default:
+      //other services are not needed by the test programs
+      break;
+  }
+
+  cpm_return(state);
+  return HOOK_SKIP;
+}
+
+CpmMachine* InitCpm(FILE *out)
+{
+  CpmMachine *cpm = calloc(1, sizeof(CpmMachine));
+  cpm->state = Init8080();
+  cpm->out = out;
+
+  //a JMP at the BDOS entry tells programs where memory ends
+  cpm->state->memory[CPM_BDOS] = 0xc3;
+  cpm->state->memory[CPM_BDOS + 1] = CPM_MEMORY_TOP & 0xff;
+  cpm->state->memory[CPM_BDOS + 2] = CPM_MEMORY_TOP >> 8;
+
+  CpmAddTrap(cpm, CPM_WARM_BOOT, warm_boot_trap);
+  CpmAddTrap(cpm, CPM_BDOS, bdos_trap);
+  return cpm;
+}
+
+void FreeCpm(CpmMachine *cpm)
+{
+  Free8080(cpm->state);
+  free(cpm);
+}
+
+/* Per-program patches, keyed by file name */
+static void patch_cpudiag(CpuState* state)
+{
+  //Fix the stack pointer from 0x6ad to 0x7ad    
+  // this 0x06 byte 112 in the code, which is    
+  // byte 112 + 0x100 = 368 in memory    
+  state->memory[368] = 0x7;    
+
+  //Skip DAA test    
+  state->memory[0x59c] = 0xc3; //JMP    
+  state->memory[0x59d] = 0xc2;    
+  state->memory[0x59e] = 0x05;
+}
+
+static const struct {
+  const char *name;
+  void (*patch)(CpuState* state);
+} cpm_fixups[] = {
+  { "cpudiag.bin", patch_cpudiag },
+};
+
+void CpmLoad(CpmMachine *cpm, const char *filename)
+{
+  CpuState *state = cpm->state;
+  const char *name = strrchr(filename, '/');
+  size_t i;
+
+  ReadFileIntoMemoryAt(state, (char *) filename, CPM_TPA_START);
+  state->pc = CPM_TPA_START;
+
+  name = name ? name + 1 : filename;
+  for (i = 0; i < sizeof(cpm_fixups) / sizeof(cpm_fixups[0]); i++)
+  {
+    if (strcmp(name, cpm_fixups[i].name) == 0)
+    {
+      cpm_fixups[i].patch(state);
+    }
+  }
+
+  //returning from the program lands on warm boot (RAM is zeroed)
+  state->sp = CPM_MEMORY_TOP - 2;
+}
+
+void CpmAddTrap(CpmMachine *cpm, uint16_t addr, CpmTrap handler)
+{
+  assert(cpm->num_traps < CPM_MAX_TRAPS);
+  cpm->trap_addr[cpm->num_traps] = addr;
+  cpm->trap_handler[cpm->num_traps] = handler;
+  cpm->num_traps++;
+  cpm->trap_bits[addr >> 6] |= 1ULL << (addr & 63);
+}
+
+static int cpm_trap(CpmMachine *cpm, uint16_t pc)
+{
+  int i;
+  for (i = 0; i < cpm->num_traps; i++)
+  {
+    if (cpm->trap_addr[i] == pc)
+    {
+      return cpm->trap_handler[i](cpm);
+    }
+  }
+  return HOOK_CONTINUE;
+}
+
+static inline int cpm_before(CpuState *state, CpmMachine *cpm)
+{
+  uint16_t pc = state->pc;
+  if (cpm->trap_bits[pc >> 6] & (1ULL << (pc & 63)))
+  {
+    return cpm_trap(cpm, pc);
+  }
+  return HOOK_CONTINUE;
+}
+
+static int contains_nocase(const char *text, const char *word)
+{
+  size_t m = strlen(word);
+  for (; *text; text++)
+  {
+    if (strncasecmp(text, word, m) == 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+const char* CpmVerdict(CpmMachine *cpm, const char *output)
+{
+  //the test programs report problems in their console output
+  if (cpm->state->halted)
+  {
+    return "unimplemented instruction";
+  }
+  if (!cpm->warm_boot)
+  {
+    return "instruction limit";
+  }
+  if (contains_nocase(output, "error") || contains_nocase(output, "fail"))
+  {
+    return "reported failure";
+  }
+  return NULL;
+}
+
+DEFINE_RUN_LOOP(RunLoopCpm, CpmMachine, cpm_before, no_hook)
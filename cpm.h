@@ -0,0 +1,65 @@
+#ifndef I8080_CPM_H
+#define I8080_CPM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "emulator.h"
+
+// High level emulation of the bits of CP/M that test programs use.
+//
+// Instead of running an operating system, the addresses programs jump to for
+// system services hold traps: when the cpu is about to execute a trapped
+// address, a C handler does the work. Only the CP/M run loop looks at the
+// trap bitmap, other machines never pay for it.
+
+#define CPM_TPA_START   0x0100   // programs load and start here
+#define CPM_BDOS        0x0005   // BDOS entry, function number in C
+#define CPM_WARM_BOOT   0x0000   // jumping here ends the program
+#define CPM_MEMORY_TOP  0xfe00   // reported to programs as the BDOS address
+
+#define CPM_MAX_TRAPS   8
+#define CPM_BUFFER_SIZE 4096
+
+typedef struct CpmMachine CpmMachine;
+
+// Trap handler, returns HOOK_SKIP to resume at the pc it left or HOOK_STOP
+typedef int (*CpmTrap)(CpmMachine *cpm);
+
+struct CpmMachine {
+  CpuState *state;
+  uint64_t trap_bits[I8080_MEMORY_SIZE / 64];  // one bit per address
+  uint16_t trap_addr[CPM_MAX_TRAPS];
+  CpmTrap  trap_handler[CPM_MAX_TRAPS];
+  int      num_traps;
+
+  FILE     *out;       // console, written through the buffer below
+  char     buffer[CPM_BUFFER_SIZE];
+  int      buffered;
+  int      warm_boot;  // set when the program exited through address 0
+};
+
+// Set up a cpu with BDOS and warm boot traps.
+//   out: where console output goes
+CpmMachine* InitCpm(FILE *out);
+void FreeCpm(CpmMachine *cpm);
+
+// Load a .COM file at 0x100 and point pc at it. Programs known to need
+// patches to run here (cpudiag.bin) get them applied.
+void CpmLoad(CpmMachine *cpm, const char *filename);
+
+// Install a trap; the address must not hold a trap already.
+void CpmAddTrap(CpmMachine *cpm, uint16_t addr, CpmTrap handler);
+
+// Write buffered console output.
+void CpmFlush(CpmMachine *cpm);
+
+// Why a finished program failed, NULL if it passed: it hit an unimplemented
+// instruction, never warm booted, or its console `output` mentions an error
+// or failure, which is how the test programs report one.
+const char* CpmVerdict(CpmMachine *cpm, const char *output);
+
+// Run loop for CP/M programs, stops at warm boot.
+uint64_t RunLoopCpm(CpuState *state, uint64_t steps, CpmMachine *ctx);
+
+#endif /* I8080_CPM_H */
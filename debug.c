@@ -0,0 +1,163 @@
+#include "debug.h"
+
+Debugger* CreateDebugger(void)
+{
+  Debugger *debugger = calloc(1, sizeof(Debugger));
+  debugger->steps = UINT64_MAX;
+  debugger->until_cycles = UINT64_MAX;
+  return debugger;
+}
+
+void FreeDebugger(Debugger *debugger)
+{
+  free(debugger);
+}
+
+static inline int is_breakpoint(Debugger *debugger, uint16_t addr)
+{
+  return (debugger->break_bits[addr >> 6] >> (addr & 63)) & 1;
+}
+
+void DebugSetBreakpoint(Debugger *debugger, uint16_t addr)
+{
+  if (!is_breakpoint(debugger, addr))
+  {
+    debugger->break_bits[addr >> 6] |= 1ULL << (addr & 63);
+    debugger->num_breakpoints++;
+  }
+}
+
+int DebugClearBreakpoint(Debugger *debugger, uint16_t addr)
+{
+  if (!is_breakpoint(debugger, addr))
+  {
+    return 0;
+  }
+  debugger->break_bits[addr >> 6] &= ~(1ULL << (addr & 63));
+  debugger->num_breakpoints--;
+  return 1;
+}
+
+/* Rebuild the page table from the watchpoint list */
+static void update_watch_pages(Debugger *debugger)
+{
+  int i;
+
+  memset(debugger->watch_pages, 0, sizeof(debugger->watch_pages));
+  for (i = 0; i < debugger->num_watchpoints; i++)
+  {
+    Watchpoint *watch = &debugger->watch[i];
+    uint32_t page = watch->addr >> DEBUG_PAGE_SHIFT;
+    uint32_t last = (watch->addr + watch->size - 1) >> DEBUG_PAGE_SHIFT;
+    for (; page <= last; page++)
+    {
+      debugger->watch_pages[page & 0xff] |= watch->kind;
+    }
+  }
+}
+
+int DebugAddWatchpoint(Debugger *debugger, uint16_t addr, uint32_t size, uint8_t kind)
+{
+  if (debugger->num_watchpoints == DEBUG_MAX_WATCHPOINTS || size == 0 ||
+      size > I8080_MEMORY_SIZE - addr)
+  {
+    return 0;
+  }
+  Watchpoint *watch = &debugger->watch[debugger->num_watchpoints++];
+  watch->addr = addr;
+  watch->size = size;
+  watch->kind = kind;
+  update_watch_pages(debugger);
+  return 1;
+}
+
+int DebugRemoveWatchpoint(Debugger *debugger, uint16_t addr)
+{
+  int i;
+
+  for (i = 0; i < debugger->num_watchpoints; i++)
+  {
+    if (debugger->watch[i].addr == addr)
+    {
+      debugger->watch[i] = debugger->watch[--debugger->num_watchpoints];
+      update_watch_pages(debugger);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Does the access overlap a watchpoint of a matching kind */
+static int watch_hit(Debugger *debugger, MemoryAccess *access)
+{
+  uint16_t last = access->addr + access->size - 1;
+  int i;
+
+  if (!(debugger->watch_pages[access->addr >> DEBUG_PAGE_SHIFT] & access->kind) &&
+      !(debugger->watch_pages[last >> DEBUG_PAGE_SHIFT] & access->kind))
+  {
+    return 0;
+  }
+  for (i = 0; i < debugger->num_watchpoints; i++)
+  {
+    Watchpoint *watch = &debugger->watch[i];
+    uint32_t offset = (uint16_t) (access->addr - watch->addr);
+    uint32_t offset_last = (uint16_t) (last - watch->addr);
+    if ((watch->kind & access->kind) &&
+        (offset < watch->size || offset_last < watch->size))
+    {
+      debugger->stop_watch = *watch;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static inline int debug_stop(Debugger *debugger, CpuState *state, int reason)
+{
+  debugger->stop = reason;
+  debugger->stop_pc = state->pc;
+  debugger->resume = 1;
+  return HOOK_STOP;
+}
+
+static inline int debug_before(Machine *machine, Debugger *debugger)
+{
+  CpuState *state = machine->state;
+  MemoryAccess *access = &debugger->stop_access;
+
+  //limits stop without resume, so a breakpoint here still counts next run
+  if (debugger->steps == 0)
+  {
+    debug_stop(debugger, state, DEBUG_STEP);
+    debugger->resume = 0;
+    return HOOK_STOP;
+  }
+  if (state->cycles >= debugger->until_cycles)
+  {
+    debug_stop(debugger, state, DEBUG_CYCLES);
+    debugger->resume = 0;
+    return HOOK_STOP;
+  }
+
+  if (debugger->resume)
+  {
+    debugger->resume = 0;
+    debugger->stop = DEBUG_RUNNING;
+  }
+  else if (is_breakpoint(debugger, state->pc))
+  {
+    return debug_stop(debugger, state, DEBUG_BREAKPOINT);
+  }
+  else if (debugger->num_watchpoints && DecodeMemoryAccess(state, access) &&
+           watch_hit(debugger, access))
+  {
+    return debug_stop(debugger, state, DEBUG_WATCHPOINT);
+  }
+  debugger->steps--;
+  return HOOK_CONTINUE;
+}
+
+DEFINE_MACHINE_RUN_FRAME(MachineRunFrameDebug, Debugger,
+                         debug_before, no_machine_hook, no_machine_hook,
+                         no_machine_limit)
@@ -0,0 +1,73 @@
+#ifndef I8080_DEBUG_H
+#define I8080_DEBUG_H
+
+#include <stdint.h>
+
+#include "access.h"
+#include "machine.h"
+
+// Breakpoints and watchpoints.
+//
+// Breakpoints are a bit per address, tested before each instruction. The
+// core has no block execution to hoist the test to, so it is a load and a
+// bit test per instruction, and only in the debug frame loop: the plain
+// MachineRunFrame does not change.
+//
+// Watchpoints first look at a per 256 byte page table of the access kinds
+// watched on that page. Only instructions touching a watched page (found by
+// DecodeMemoryAccess) go on to compare against the watchpoint list. There
+// is no memory bus to remap pages on, so the decoder stands in for it.
+
+#define DEBUG_MAX_WATCHPOINTS 16
+#define DEBUG_PAGE_SHIFT      8
+
+// Why a debug run stopped
+#define DEBUG_RUNNING    0
+#define DEBUG_BREAKPOINT 1
+#define DEBUG_WATCHPOINT 2
+#define DEBUG_STEP       3   // ran out of steps
+#define DEBUG_CYCLES     4   // reached until_cycles
+
+typedef struct {
+  uint16_t addr;
+  uint32_t size;     // up to the end of memory
+  uint8_t  kind;     // ACCESS_* bits
+} Watchpoint;
+
+typedef struct {
+  uint64_t   break_bits[I8080_MEMORY_SIZE / 64];
+  int        num_breakpoints;
+  uint8_t    watch_pages[I8080_MEMORY_SIZE >> DEBUG_PAGE_SHIFT];
+  Watchpoint watch[DEBUG_MAX_WATCHPOINTS];
+  int        num_watchpoints;
+
+  uint64_t   steps;        // instructions left to run, UINT64_MAX for no limit
+  uint64_t   until_cycles; // stop once the cpu reaches this cycle count
+  int        resume;       // run the instruction at pc unchecked, set on stop
+  int        stop;         // DEBUG_* reason of the last stop
+  uint16_t   stop_pc;
+  MemoryAccess stop_access; // access that hit a watchpoint
+  Watchpoint stop_watch;   // and the watchpoint it hit
+} Debugger;
+
+Debugger* CreateDebugger(void);
+void FreeDebugger(Debugger *debugger);
+
+void DebugSetBreakpoint(Debugger *debugger, uint16_t addr);
+//   @return: 0 if there was no breakpoint at addr
+int DebugClearBreakpoint(Debugger *debugger, uint16_t addr);
+
+// Watch `size` bytes from addr for the ACCESS_* kinds given.
+//   @return: 0 if all watchpoint slots are in use, or size is 0 or runs
+//            past the end of memory
+int DebugAddWatchpoint(Debugger *debugger, uint16_t addr, uint32_t size, uint8_t kind);
+//   @return: 0 if no watchpoint starts at addr
+int DebugRemoveWatchpoint(Debugger *debugger, uint16_t addr);
+
+// MachineRunFrame stopping before an instruction at a breakpoint or one
+// that touches a watched byte, or when the step or cycle limit is reached.
+// Returns 0 on a stop with debugger->stop set; calling it again resumes the
+// same frame with that instruction.
+int MachineRunFrameDebug(Machine *machine, Debugger *debugger);
+
+#endif /* I8080_DEBUG_H */
@@ -0,0 +1,181 @@
+#include "difftest.h"
+#include "disassembler.h"
+#include "runloop.h"
+
+// The fields compare_states looks at, packed so a compare is two loads
+typedef struct {
+  uint64_t regs;    // a b c d e h l flags
+  uint32_t sp_pc;
+} PackedState;
+
+static inline PackedState pack_state(CpuState *state)
+{
+  PackedState packed;
+  packed.regs = ((uint64_t) state->a << 56) | ((uint64_t) state->b << 48) |
+                ((uint64_t) state->c << 40) | ((uint64_t) state->d << 32) |
+                ((uint64_t) state->e << 24) | ((uint64_t) state->h << 16) |
+                ((uint64_t) state->l << 8) |
+                (state->cc.z | state->cc.s << 1 | state->cc.p << 2 |
+                 state->cc.cy << 3);
+  packed.sp_pc = ((uint32_t) state->sp << 16) | state->pc;
+  return packed;
+}
+
+static inline int packed_equal(CpuState *state1, CpuState *state2)
+{
+  PackedState p1 = pack_state(state1);
+  PackedState p2 = pack_state(state2);
+  return (p1.regs == p2.regs) && (p1.sp_pc == p2.sp_pc);
+}
+
+static inline int memory_equal(CpuState *state1, CpuState *state2)
+{
+  return memcmp(state1->memory, state2->memory, I8080_MEMORY_SIZE) == 0;
+}
+
+/* Snapshot of a cpu: registers by value plus a copy of RAM */
+typedef struct {
+  CpuState regs;
+  uint8_t  *memory;
+  uint64_t step;
+} DiffSnapshot;
+
+static void take_snapshot(DiffSnapshot *snapshot, CpuState *state, uint64_t step)
+{
+  snapshot->regs = *state;
+  memcpy(snapshot->memory, state->memory, I8080_MEMORY_SIZE);
+  snapshot->step = step;
+}
+
+static void restore_snapshot(DiffSnapshot *snapshot, CpuState *state)
+{
+  uint8_t *memory = state->memory;
+  *state = snapshot->regs;
+  state->memory = memory;
+  memcpy(state->memory, snapshot->memory, I8080_MEMORY_SIZE);
+}
+
+/* Single-step from the snapshot until the cpus disagree */
+static uint64_t pinpoint(DiffSnapshot *snapshot, CpuState *state,
+                         CpuState *state_ref, uint64_t limit)
+{
+  uint64_t step;
+
+  restore_snapshot(snapshot, state);
+  restore_snapshot(snapshot, state_ref);
+
+  for (step = snapshot->step; step < limit; step++)
+  {
+    uint16_t pc = state->pc;
+
+    Emulate8080Op(state);
+    Emulate8080Op_ref(state_ref);
+
+    if (!packed_equal(state, state_ref) || !memory_equal(state, state_ref) ||
+        state->halted || state_ref->halted)
+    {
+      printf("First divergence at instruction %llu:\n", (unsigned long long) step);
+      Disassemble8080Op(state->memory, pc);
+      compare_states(state, state_ref);
+      if (!memory_equal(state, state_ref))
+      {
+        int i;
+        for (i = 0; i < I8080_MEMORY_SIZE; i++)
+        {
+          if (state->memory[i] != state_ref->memory[i])
+          {
+            printf("\tmemory $%04x: $%02x vs $%02x\n", i, state->memory[i],
+                   state_ref->memory[i]);
+          }
+        }
+      }
+      return step;
+    }
+  }
+  printf("Divergence did not reproduce from instruction %llu\n",
+         (unsigned long long) snapshot->step);
+  return limit;
+}
+
+typedef struct {
+  CpuState     *state_ref;
+  DiffSnapshot snapshot;
+  uint64_t     step;
+  uint32_t     check_interval;
+  int          diverged;
+} DiffContext;
+
+/* Step the reference cpu behind the one under test and compare */
+static inline int diff_after(CpuState *state, DiffContext *ctx)
+{
+  CpuState *state_ref = ctx->state_ref;
+
+  Emulate8080Op_ref(state_ref);
+  ctx->step++;
+
+  if (!packed_equal(state, state_ref))
+  {
+    ctx->diverged = 1;
+    return HOOK_STOP;
+  }
+  if (state->halted || state_ref->halted)
+  {
+    //both stopped on the same unimplemented instruction
+    return HOOK_STOP;
+  }
+  if (ctx->step % ctx->check_interval == 0)
+  {
+    if (!memory_equal(state, state_ref))
+    {
+      ctx->diverged = 1;
+      return HOOK_STOP;
+    }
+    take_snapshot(&ctx->snapshot, state, ctx->step);
+  }
+  return HOOK_CONTINUE;
+}
+
+static inline int diff_before(CpuState *state, DiffContext *ctx)
+{
+  return HOOK_CONTINUE;
+}
+
+static DEFINE_RUN_LOOP(run_loop_diff, DiffContext, diff_before, diff_after)
+
+uint64_t RunDifferential(CpuState *state, CpuState *state_ref, uint64_t steps,
+                         uint32_t check_interval)
+{
+  DiffContext ctx;
+  int saved_trace = ref_trace;
+
+  //snapshots are only valid where both cpus agree
+  if (!packed_equal(state, state_ref) || !memory_equal(state, state_ref))
+  {
+    printf("States differ before the first instruction\n");
+    compare_states(state, state_ref);
+    return 0;
+  }
+
+  ref_trace = 0;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.state_ref = state_ref;
+  ctx.check_interval = check_interval;
+  ctx.snapshot.memory = malloc(I8080_MEMORY_SIZE);
+  take_snapshot(&ctx.snapshot, state, 0);
+
+  run_loop_diff(state, steps, &ctx);
+
+  if (ctx.diverged)
+  {
+    ctx.step = pinpoint(&ctx.snapshot, state, state_ref, ctx.step);
+  }
+  else if (state->halted || state_ref->halted)
+  {
+    printf("Both cores halted after %llu instructions\n",
+           (unsigned long long) ctx.step);
+  }
+
+  free(ctx.snapshot.memory);
+  ref_trace = saved_trace;
+  return ctx.step;
+}
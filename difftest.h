@@ -0,0 +1,21 @@
+#ifndef I8080_DIFFTEST_H
+#define I8080_DIFFTEST_H
+
+#include <stdint.h>
+
+#include "emulator.h"
+
+// Run Emulate8080Op on `state` and Emulate8080Op_ref on `state_ref` side by
+// side, without tracing.
+//
+// Registers are compared after every instruction as two packed words. RAM is
+// compared every `check_interval` instructions, and each time everything
+// matches a snapshot is kept. On divergence both cpus are rewound to that
+// snapshot and single-stepped with full compares to report the first
+// instruction whose result differs.
+//   steps: instructions to run
+//   @return: instructions executed before the first divergence, or `steps`
+uint64_t RunDifferential(CpuState *state, CpuState *state_ref, uint64_t steps,
+                         uint32_t check_interval);
+
+#endif /* I8080_DIFFTEST_H */
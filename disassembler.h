@@ -1,12 +1,53 @@
 #ifndef I8080_DISASSEMBLER_H
 #define I8080_DISASSEMBLER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-// Reads memory and disassemble one 8080 op code.
+// How the bytes after the opcode are printed
+#define OPERAND_NONE 0
+#define OPERAND_D8   1   // immediate byte, #$12
+#define OPERAND_D16  2   // immediate word, #$1234
+#define OPERAND_ADDR 3   // address, $1234
+
+// What the disassembler and the core know about an opcode.
+typedef struct {
+  char    mnemonic[5];
+  char    operands[4];   // registers, with a trailing ',' before an immediate
+  uint8_t kind;          // OPERAND_*
+  uint8_t length;        // bytes
+  uint8_t cycles;        // not-taken count for conditional CALL/RET
+} Opcode8080;
+
+extern const Opcode8080 opcodes8080[256];
+
+// Longest line Format8080Op writes, NUL included
+#define DISASM_LINE_SIZE 32
+
+// Reads memory and disassemble one 8080 op code to stdout.
 //   codebuffer: pointer to 8080 binary code
 //   pc: current offset into the code
 //   @return: number of bytes
 int Disassemble8080Op(uint8_t *codebuffer, uint16_t pc);
 
+// Write the instruction at `pc` into `out` as "01a2f MVI    B, #$10" with
+// a NUL, using at most DISASM_LINE_SIZE bytes.
+//   @return: number of bytes in the instruction
+int Format8080Op(const uint8_t *codebuffer, uint16_t pc, char *out);
+
+// Disassemble from *pc up to `end` into `out`, one line per instruction
+// ending in '\n', and stop early when `size` bytes cannot hold another line.
+// *pc is left after the last instruction written. The operands of the last
+// instruction may be read from up to two bytes past `end`.
+//   @return: number of characters written, there is no NUL
+size_t Disassemble8080Range(const uint8_t *codebuffer, uint32_t *pc, uint32_t end,
+                            char *out, size_t size);
+
+// Number of bytes in the instruction starting with `opcode`, without
+// printing anything.
+static inline int Length8080Op(uint8_t opcode)
+{
+  return opcodes8080[opcode].length;
+}
+
 #endif
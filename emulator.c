@@ -8,7 +8,8 @@ void UnimplementedInstruction(CpuState* state)
   state->pc--;
   Disassemble8080Op(state->memory, state->pc);
   printf("\n");
-  exit(1);
+  //leave it to the caller to decide whether to stop the machine
+  state->halted = 1;
 }
 
 void ReadFileIntoMemoryAt(CpuState* state, char* filename, uint32_t offset)
@@ -30,9 +31,16 @@ void ReadFileIntoMemoryAt(CpuState* state, char* filename, uint32_t offset)
 
 CpuState* Init8080(void)
 {
-  CpuState* state = calloc(1,sizeof(CpuState));
-  state->memory = malloc(0x10000);  //16K
-  return state;
+  CpuInstance* instance = aligned_alloc(I8080_CACHE_LINE, sizeof(CpuInstance));
+  memset(instance, 0, sizeof(CpuInstance));
+  instance->state.memory = instance->memory;  //64K
+  return &instance->state;
+}
+
+void Free8080(CpuState* state)
+{
+  //state is the first member of its instance
+  free(state);
 }
 
 
@@ -184,6 +192,38 @@ int compare_states(CpuState* state1, CpuState* state2)
   return equal;
 }
 
+#define HASH_PRIME 0x100000001b3ULL
+
+static inline uint64_t hash_mix(uint64_t hash, uint64_t x)
+{
+  return (hash ^ x) * HASH_PRIME;
+}
+
+uint64_t Hash8080(CpuState* state)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint64_t word;
+  int i;
+
+  hash = hash_mix(hash, ((uint64_t) state->a << 56) | ((uint64_t) state->b << 48) |
+                        ((uint64_t) state->c << 40) | ((uint64_t) state->d << 32) |
+                        ((uint64_t) state->e << 24) | ((uint64_t) state->h << 16) |
+                        ((uint64_t) state->l << 8));
+  hash = hash_mix(hash, ((uint64_t) state->sp << 32) | ((uint64_t) state->pc << 16) |
+                        (state->cc.z | state->cc.s << 1 | state->cc.p << 2 |
+                         state->cc.cy << 3 | state->cc.ac << 4 |
+                         state->int_enable << 5));
+  hash = hash_mix(hash, state->cycles);
+
+  //memory a word at a time, it dominates the cost
+  for (i = 0; i < I8080_MEMORY_SIZE; i += sizeof(word))
+  {
+    memcpy(&word, &state->memory[i], sizeof(word));
+    hash = hash_mix(hash, word);
+  }
+  return hash;
+}
+
 #define BIT(n) (1 << (n))
 #define BITMASK(m) (BIT(m) - 1)
 
@@ -318,6 +358,7 @@ void Emulate8080Op(CpuState* state)
 
   uint16_t offset, ccc, condition;
   
+  state->cycles += opcodes8080[*opcode].cycles;
   state->pc++;
   
   /* Process opcode */
@@ -723,10 +764,17 @@ void Emulate8080Op(CpuState* state)
   if (*opcode == 0xfb) //EI 
   {
     //enable interrupts
-    printf("EI: enable interrupts\n");
+    state->int_enable = 1;
     return;
   }   
 
+  if (*opcode == 0xf3) //DI
+  {
+    //disable interrupts
+    state->int_enable = 0;
+    return;
+  }
+
   switch(*opcode)
   {
     /*! NOP group */
@@ -990,30 +1038,6 @@ void Emulate8080Op(CpuState* state)
       break;
 
     case 0xcd: //CALL ADDR
- #ifdef DBG_TEST  
-            if (5 ==  ((opcode[2] << 8) | opcode[1]))    
-            {    
-                if (state->c == 9)    
-                {    
-                    uint16_t offset = (state->d<<8) | (state->e);    
-                    char *str = &state->memory[offset+3];  //skip the prefix bytes    
-                    while (*str != '$')    
-                        printf("%c", *str++);    
-                    
-                    printf("\n");    
-                }    
-                else if (state->c == 2)    
-                {    
-                    //printf ("print char routine called\n");
-										printf("%c", state->e);
-                }    
-            }    
-            else if (0 ==  ((opcode[2] << 8) | opcode[1]))    
-            {    
-                exit(0);    
-            }    
-            else    
- #endif 
       {
       uint16_t ret = state->pc + 2;
       state->memory[state->sp - 1] = (ret >> 8) & 0xff;
@@ -1057,6 +1081,7 @@ void Emulate8080Op(CpuState* state)
 
       if (condition)
       {
+        state->cycles += 6;
         uint16_t ret = state->pc + 2;
         state->memory[state->sp - 1] = (ret >> 8) & 0xff;
         state->memory[state->sp - 2] = (ret & 0xff);
@@ -1099,6 +1124,7 @@ void Emulate8080Op(CpuState* state)
 
       if (condition)
       {
+        state->cycles += 6;
         state->pc = state->memory[state->sp] | (state->memory[state->sp + 1] << 8);
         state->pc += 2;
       }
@@ -33,8 +33,20 @@ typedef struct {
   uint8_t  *memory;
   struct   ConditionCodes     cc;
   uint8_t  int_enable;
+  uint8_t  halted;      // set when an unimplemented opcode is hit
+  uint64_t cycles;      // total clock cycles executed
 } CpuState;
 
+#define I8080_MEMORY_SIZE 0x10000
+#define I8080_CACHE_LINE  64
+
+// A cpu and its RAM in one cache line aligned block, so the registers sit
+// next to the memory they work on and an instance is one allocation.
+typedef struct {
+  CpuState state;
+  uint8_t  memory[I8080_MEMORY_SIZE] __attribute__((aligned(I8080_CACHE_LINE)));
+} CpuInstance;
+
 typedef uint8_t UWord8;
 
 typedef union {
@@ -51,11 +63,19 @@ typedef union {
 
 void Emulate8080Op(CpuState* state);
 int Emulate8080Op_ref(CpuState* state);
+// Disassemble every instruction the reference core executes, on by default
+extern int ref_trace;
 
+// Allocate a cpu with zeroed registers and RAM.
 CpuState* Init8080(void);
+// Release a cpu allocated by Init8080.
+void Free8080(CpuState* state);
 
 void ReadFileIntoMemoryAt(CpuState* state, char* filename, uint32_t offset);
 
+void print_state(CpuState *state);
 int compare_states(CpuState* state1, CpuState* state2);
+// 64 bit hash of registers, flags, cycle count and RAM
+uint64_t Hash8080(CpuState* state);
 void UnimplementedInstruction(CpuState* state);
 #endif /* I8080_EMULATOR_H */
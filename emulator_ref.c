@@ -1,9 +1,10 @@
-#ifdef DBG_REF
 #include "emulator.h"
 #include "disassembler.h"
 
 ConditionCodes CC_ZSPAC = {1,1,1,0,1};
 
+int ref_trace = 1;
+
 int parity(int x, int size)
 {
   int i;
@@ -38,7 +39,10 @@ int Emulate8080Op_ref(CpuState* state)
   int cycles = 4;
   unsigned char *opcode = &state->memory[state->pc];
 
-  Disassemble8080Op(state->memory, state->pc); 
+  if (ref_trace)
+  {
+    Disassemble8080Op(state->memory, state->pc); 
+  }
   state->pc+=1; 
   
   switch (*opcode)
@@ -557,5 +561,3 @@ int Emulate8080Op_ref(CpuState* state)
 #endif
   return 0;
 }
-
-#endif
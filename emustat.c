@@ -0,0 +1,64 @@
+#include <signal.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+static void usage(void)
+{
+  printf("usage: emustat [name] [lines]\n"
+         "  print the counters published by emulator --publish once a second,\n"
+         "  name defaults to %s\n", COUNTERS_NAME);
+}
+
+int main (int argc, char** argv)
+{
+  const char *name = argc > 1 ? argv[1] : COUNTERS_NAME;
+  long lines = argc > 2 ? atol(argv[2]) : -1;
+
+  if (argc > 3 || (argc > 1 && argv[1][0] == '-'))
+  {
+    usage();
+    return 1;
+  }
+
+  const SharedCounters *shared = OpenCounters(name);
+  if (shared == NULL)
+  {
+    return 1;
+  }
+
+  SharedCounters last, now;
+  ReadCounters(shared, &last);
+  printf("%10s %8s %10s %8s %8s %6s\n", "frames", "fps", "MIPS", "irq/s",
+         "speed", "unimp");
+  while (lines != 0)
+  {
+    sleep(1);
+    ReadCounters(shared, &now);
+    double seconds = (now.elapsed_ns - last.elapsed_ns) * 1e-9;
+    if (seconds <= 0)
+    {
+      //nothing published in the last second
+      if (kill(now.pid, 0) != 0)
+      {
+        printf("emulator %u has exited\n", now.pid);
+        break;
+      }
+      continue;
+    }
+    printf("%10llu %8.1f %10.2f %8.1f %7.2fx %6llu\n",
+           (unsigned long long) now.frames,
+           (now.frames - last.frames) / seconds,
+           (now.instructions - last.instructions) / seconds * 1e-6,
+           (now.interrupts - last.interrupts) / seconds,
+           now.speed, (unsigned long long) now.unimplemented);
+    fflush(stdout);
+    last = now;
+    if (lines > 0)
+    {
+      lines--;
+    }
+  }
+  CloseCounters(shared);
+  return 0;
+}
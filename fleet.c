@@ -0,0 +1,248 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fleet.h"
+#include "coverage.h"
+#include "sampler.h"
+
+// Deque of machine indices; owner uses the bottom, thieves use the top.
+typedef struct {
+  pthread_mutex_t lock;
+  int *items;
+  int top;
+  int bottom;
+} FleetDeque;
+
+typedef struct Fleet Fleet;
+
+typedef struct {
+  Fleet *fleet;
+  int   id;
+  FleetWorkerStats stats;
+} FleetWorker;
+
+struct Fleet {
+  Machine        **machines;
+  uint32_t       *remaining;
+  int            count;
+  int            slice_frames;
+  int            num_workers;
+  FleetDeque     *deques;
+  FleetWorker    *workers;
+  atomic_int     unfinished;
+};
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A machine is in at most one deque at a time, so `count` slots never wrap.
+static void deque_push_bottom(FleetDeque *deque, int item)
+{
+  pthread_mutex_lock(&deque->lock);
+  deque->items[deque->bottom++] = item;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+static int deque_pop_bottom(FleetDeque *deque)
+{
+  int item = -1;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top)
+  {
+    item = deque->items[--deque->bottom];
+  }
+  if (deque->bottom == deque->top)
+  {
+    deque->bottom = deque->top = 0;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return item;
+}
+
+static int deque_steal_top(FleetDeque *deque)
+{
+  int item = -1;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top)
+  {
+    item = deque->items[deque->top++];
+  }
+  if (deque->bottom == deque->top)
+  {
+    deque->bottom = deque->top = 0;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return item;
+}
+
+static int find_work(FleetWorker *worker)
+{
+  Fleet *fleet = worker->fleet;
+  int item = deque_pop_bottom(&fleet->deques[worker->id]);
+  int i;
+
+  for (i = 1; item < 0 && i < fleet->num_workers; i++)
+  {
+    int victim = (worker->id + i) % fleet->num_workers;
+    item = deque_steal_top(&fleet->deques[victim]);
+    if (item >= 0)
+    {
+      worker->stats.steals++;
+    }
+  }
+  return item;
+}
+
+static void *fleet_worker(void *arg)
+{
+  FleetWorker *worker = arg;
+  Fleet *fleet = worker->fleet;
+  double start = now_seconds();
+
+  while (atomic_load(&fleet->unfinished) > 0)
+  {
+    int item = find_work(worker);
+    if (item < 0)
+    {
+      //everything left is being run by other workers
+      sched_yield();
+      continue;
+    }
+
+    Machine *machine = fleet->machines[item];
+    uint32_t frames = fleet->remaining[item];
+    if (frames > (uint32_t) fleet->slice_frames)
+    {
+      frames = fleet->slice_frames;
+    }
+
+    double slice_start = now_seconds();
+    uint32_t f;
+    for (f = 0; f < frames && !machine->state->halted; f++)
+    {
+      if (machine->coverage)
+      {
+        MachineRunFrameCoverage(machine, machine->coverage);
+      }
+      else if (machine->sampler)
+      {
+        MachineRunFrameSampled(machine, machine->sampler);
+      }
+      else
+      {
+        MachineRunFrame(machine);
+      }
+    }
+    worker->stats.busy_seconds += now_seconds() - slice_start;
+    worker->stats.slices++;
+
+    fleet->remaining[item] -= frames;
+    if (fleet->remaining[item] > 0 && !machine->state->halted)
+    {
+      deque_push_bottom(&fleet->deques[worker->id], item);
+    }
+    else
+    {
+      atomic_fetch_sub(&fleet->unfinished, 1);
+    }
+  }
+
+  worker->stats.wall_seconds = now_seconds() - start;
+  return NULL;
+}
+
+int FleetNumCores(void)
+{
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return (cores > 0) ? (int) cores : 1;
+}
+
+int RunFleet(Machine **machines, const uint32_t *frames, int count,
+             int workers, int slice_frames, FleetWorkerStats *stats)
+{
+  Fleet fleet;
+  pthread_t *threads;
+  int i;
+
+  if (workers <= 0)
+  {
+    workers = FleetNumCores();
+  }
+  if (slice_frames <= 0)
+  {
+    slice_frames = 1;
+  }
+
+  fleet.machines = machines;
+  fleet.count = count;
+  fleet.slice_frames = slice_frames;
+  fleet.num_workers = workers;
+  fleet.remaining = malloc(count * sizeof(uint32_t));
+  fleet.deques = calloc(workers, sizeof(FleetDeque));
+  fleet.workers = calloc(workers, sizeof(FleetWorker));
+  threads = malloc(workers * sizeof(pthread_t));
+  atomic_init(&fleet.unfinished, 0);
+
+  for (i = 0; i < workers; i++)
+  {
+    pthread_mutex_init(&fleet.deques[i].lock, NULL);
+    fleet.deques[i].items = malloc(count * sizeof(int));
+    fleet.workers[i].fleet = &fleet;
+    fleet.workers[i].id = i;
+  }
+
+  //deal the machines out round robin
+  for (i = 0; i < count; i++)
+  {
+    fleet.remaining[i] = frames[i];
+    if (frames[i] > 0 && !machines[i]->state->halted)
+    {
+      deque_push_bottom(&fleet.deques[i % workers], i);
+      atomic_fetch_add(&fleet.unfinished, 1);
+    }
+  }
+
+  for (i = 0; i < workers; i++)
+  {
+    pthread_create(&threads[i], NULL, fleet_worker, &fleet.workers[i]);
+  }
+  for (i = 0; i < workers; i++)
+  {
+    pthread_join(threads[i], NULL);
+    if (stats)
+    {
+      stats[i] = fleet.workers[i].stats;
+    }
+    pthread_mutex_destroy(&fleet.deques[i].lock);
+    free(fleet.deques[i].items);
+  }
+
+  free(threads);
+  free(fleet.workers);
+  free(fleet.deques);
+  free(fleet.remaining);
+  return workers;
+}
+
+void PrintFleetStats(const FleetWorkerStats *stats, int workers)
+{
+  int i;
+  for (i = 0; i < workers; i++)
+  {
+    double utilization = 0;
+    if (stats[i].wall_seconds > 0)
+    {
+      utilization = 100.0 * stats[i].busy_seconds / stats[i].wall_seconds;
+    }
+    printf("worker %2d: %5.1f%% busy, %llu slices, %llu steals\n", i,
+           utilization, (unsigned long long) stats[i].slices,
+           (unsigned long long) stats[i].steals);
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef I8080_FLEET_H
+#define I8080_FLEET_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+// Per-worker counters reported by RunFleet
+typedef struct {
+  double   busy_seconds;   // time spent running frames
+  double   wall_seconds;   // time from worker start to fleet completion
+  uint64_t slices;         // slices executed
+  uint64_t steals;         // slices taken from another worker's deque
+} FleetWorkerStats;
+
+// Run many independent machines on a work-stealing pool.
+//   machines: machines to run
+//   frames: number of frames to run on each machine
+//   count: number of machines
+//   workers: number of threads, 0 to use FleetNumCores()
+//   slice_frames: frames run before a machine is requeued
+//   stats: optional array with one entry per worker
+//   @return: number of workers used
+//
+// Each worker owns a deque of machines. It pops from the bottom of its own
+// deque, runs one slice and pushes the machine back if it has frames left.
+// When its deque is empty it steals from the top of another worker's deque,
+// so long-running machines spread out while short ones drain.
+// Machines with machine->coverage set record coverage into it, otherwise
+// machines with machine->sampler set are sampled.
+int RunFleet(Machine **machines, const uint32_t *frames, int count,
+             int workers, int slice_frames, FleetWorkerStats *stats);
+
+// Number of online cores, the default worker count
+int FleetNumCores(void);
+
+// Print one line of utilization per worker
+void PrintFleetStats(const FleetWorkerStats *stats, int workers);
+
+#endif /* I8080_FLEET_H */
@@ -0,0 +1,701 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "gdbstub.h"
+
+#define GDB_REGISTERS     6    // af bc de hl sp pc
+#define GDB_Z80_REGISTERS 13   // gdb's z80 set adds ix iy, shadows and ir
+
+#define GDB_SIGINT  2
+#define GDB_SIGILL  4
+#define GDB_SIGTRAP 5
+
+// What the target does after a packet
+#define GDB_STOPPED 0   // stays stopped, wait for the next packet
+#define GDB_RESUME  1
+#define GDB_DETACH  2
+#define GDB_KILL    3
+
+GdbStub* CreateGdbStub(const char *address)
+{
+  GdbStub *stub = calloc(1, sizeof(GdbStub));
+  char *end;
+  long port = strtol(address, &end, 10);
+  int fd, ok;
+
+  stub->client_fd = -1;
+  if (end != address && *end == '\0')
+  {
+    struct sockaddr_in addr;
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ok = port > 0 && port < 65536 && fd >= 0 &&
+         bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0;
+  }
+  else
+  {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    //only a stale socket is replaced, never a file that happens to be there
+    ok = strlen(address) < sizeof(addr.sun_path) && fd >= 0;
+    if (ok && lstat(address, &st) == 0)
+    {
+      ok = S_ISSOCK(st.st_mode) && unlink(address) == 0;
+    }
+    ok = ok && bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0;
+    if (ok)
+    {
+      stub->path = strdup(address);
+    }
+  }
+
+  if (!ok || listen(fd, 1) != 0)
+  {
+    printf("error: cannot listen on %s\n", address);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    free(stub->path);
+    free(stub);
+    return NULL;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  stub->listen_fd = fd;
+  stub->debugger = CreateDebugger();
+  printf("gdb: listening on %s\n", address);
+  return stub;
+}
+
+static void detach(GdbStub *stub)
+{
+  close(stub->client_fd);
+  stub->client_fd = -1;
+
+  //a client that went away leaves no breakpoints behind
+  FreeDebugger(stub->debugger);
+  stub->debugger = CreateDebugger();
+  printf("gdb: client detached\n");
+}
+
+void FreeGdbStub(GdbStub *stub)
+{
+  if (stub->client_fd >= 0)
+  {
+    close(stub->client_fd);
+  }
+  close(stub->listen_fd);
+  if (stub->path)
+  {
+    struct stat st;
+    if (lstat(stub->path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+      unlink(stub->path);
+    }
+    free(stub->path);
+  }
+  FreeDebugger(stub->debugger);
+  free(stub);
+}
+
+static int accept_client(GdbStub *stub)
+{
+  int fd = accept(stub->listen_fd, NULL, NULL);
+  int one = 1;
+
+  if (fd < 0)
+  {
+    return 0;
+  }
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  stub->client_fd = fd;
+  stub->no_ack = 0;
+  stub->in_pos = 0;
+  stub->in_len = 0;
+  printf("gdb: client attached\n");
+  return 1;
+}
+
+/* Packet I/O */
+
+static int read_byte(GdbStub *stub)
+{
+  if (stub->in_pos == stub->in_len)
+  {
+    ssize_t n = recv(stub->client_fd, stub->in, sizeof(stub->in), 0);
+    if (n <= 0)
+    {
+      return -1;
+    }
+    stub->in_pos = 0;
+    stub->in_len = n;
+  }
+  return stub->in[stub->in_pos++];
+}
+
+// Look for a Ctrl-C from the client without blocking.
+//   @return: 1 on an interrupt, -1 if the client went away
+static int poll_interrupt(GdbStub *stub)
+{
+  if (stub->in_pos == stub->in_len)
+  {
+    ssize_t n = recv(stub->client_fd, stub->in, sizeof(stub->in), MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+      return -1;
+    }
+    stub->in_pos = 0;
+    stub->in_len = n > 0 ? n : 0;
+  }
+  //nothing else is expected while running
+  while (stub->in_pos < stub->in_len)
+  {
+    if (stub->in[stub->in_pos++] == 0x03)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int send_all(GdbStub *stub, const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = send(stub->client_fd, data, size, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      return -1;
+    }
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static int hex_value(int c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Next packet into stub->packet, NUL terminated.
+//   @return: its length, -1 if the client went away
+static int get_packet(GdbStub *stub)
+{
+  for (;;)
+  {
+    int c, len = 0;
+    uint8_t sum = 0;
+
+    do
+    {
+      c = read_byte(stub);
+      if (c < 0)
+      {
+        return -1;
+      }
+    } while (c != '$');
+
+    while ((c = read_byte(stub)) != '#')
+    {
+      if (c < 0)
+      {
+        return -1;
+      }
+      if (len < GDB_PACKET_SIZE - 1)
+      {
+        stub->packet[len++] = c;
+      }
+      sum += c;
+    }
+    stub->packet[len] = '\0';
+
+    int hi = read_byte(stub);
+    int lo = read_byte(stub);
+    if (hi < 0 || lo < 0)
+    {
+      return -1;
+    }
+    if (stub->no_ack)
+    {
+      return len;
+    }
+    if (hex_value(hi) * 16 + hex_value(lo) == sum)
+    {
+      return send_all(stub, "+", 1) < 0 ? -1 : len;
+    }
+    if (send_all(stub, "-", 1) < 0)
+    {
+      return -1;
+    }
+  }
+}
+
+static int put_packet(GdbStub *stub, const char *data)
+{
+  static char out[GDB_PACKET_SIZE + 4];
+  size_t len = strlen(data);
+  uint8_t sum = 0;
+  size_t i;
+
+  out[0] = '$';
+  for (i = 0; i < len; i++)
+  {
+    out[1 + i] = data[i];
+    sum += (uint8_t) data[i];
+  }
+  sprintf(&out[1 + len], "#%02x", sum);
+
+  for (;;)
+  {
+    if (send_all(stub, out, len + 4) < 0)
+    {
+      return -1;
+    }
+    if (stub->no_ack)
+    {
+      return 0;
+    }
+    int c = read_byte(stub);
+    if (c < 0)
+    {
+      return -1;
+    }
+    if (c != '-')
+    {
+      //anything but a nak counts as an ack; keep a packet start for later
+      if (c != '+')
+      {
+        stub->in_pos--;
+      }
+      return 0;
+    }
+  }
+}
+
+/* Registers and memory */
+
+static uint32_t parse_hex(const char **text)
+{
+  uint32_t x = 0;
+  int v;
+
+  while ((v = hex_value(**text)) >= 0)
+  {
+    x = (x << 4) | v;
+    (*text)++;
+  }
+  return x;
+}
+
+// Two hex digits, -1 if they are not
+static int parse_byte(const char **text)
+{
+  int hi = hex_value((*text)[0]);
+  int lo = hi >= 0 ? hex_value((*text)[1]) : -1;
+
+  if (lo < 0)
+  {
+    return -1;
+  }
+  *text += 2;
+  return hi * 16 + lo;
+}
+
+static uint16_t get_register(CpuState *state, int n)
+{
+  switch (n)
+  {
+    case 0:
+      return (state->a << 8) | (state->cc.s << 7) | (state->cc.z << 6) |
+             (state->cc.ac << 4) | (state->cc.p << 2) | 0x02 | state->cc.cy;
+    case 1:  return (state->b << 8) | state->c;
+    case 2:  return (state->d << 8) | state->e;
+    case 3:  return (state->h << 8) | state->l;
+    case 4:  return state->sp;
+    default: return state->pc;
+  }
+}
+
+static void set_register(CpuState *state, int n, uint16_t x)
+{
+  switch (n)
+  {
+    case 0:
+      state->a = x >> 8;
+      state->cc.s = (x >> 7) & 1;
+      state->cc.z = (x >> 6) & 1;
+      state->cc.ac = (x >> 4) & 1;
+      state->cc.p = (x >> 2) & 1;
+      state->cc.cy = x & 1;
+      break;
+    case 1:  state->b = x >> 8; state->c = x; break;
+    case 2:  state->d = x >> 8; state->e = x; break;
+    case 3:  state->h = x >> 8; state->l = x; break;
+    case 4:  state->sp = x; break;
+    default: state->pc = x; break;
+  }
+}
+
+// Registers go over the wire little endian
+static char* put_register(char *p, uint16_t x)
+{
+  return p + sprintf(p, "%02x%02x", x & 0xff, x >> 8);
+}
+
+static int parse_register(const char **text, uint16_t *x)
+{
+  int lo = parse_byte(text);
+  int hi = lo >= 0 ? parse_byte(text) : -1;
+
+  if (hi < 0)
+  {
+    return 0;
+  }
+  *x = (hi << 8) | lo;
+  return 1;
+}
+
+/* Packets */
+
+static uint8_t watch_kind(int type)
+{
+  switch (type)
+  {
+    case 2:  return ACCESS_WRITE;
+    case 3:  return ACCESS_READ;
+    default: return ACCESS_READ | ACCESS_WRITE;
+  }
+}
+
+// Z and z: type 0 and 1 are breakpoints, 2 to 4 write, read and access
+// watchpoints of `kind` bytes
+static void breakpoint_packet(GdbStub *stub, const char *p)
+{
+  int insert = *p++ == 'Z';
+  uint32_t type = parse_hex(&p);
+  uint32_t addr = *p == ',' ? (p++, parse_hex(&p)) : 0;
+  uint32_t size = *p == ',' ? (p++, parse_hex(&p)) : 1;
+  int ok = 1;
+
+  if (type <= 1)
+  {
+    if (insert)
+    {
+      DebugSetBreakpoint(stub->debugger, addr);
+    }
+    else
+    {
+      DebugClearBreakpoint(stub->debugger, addr);
+    }
+  }
+  else if (type <= 4)
+  {
+    ok = insert ? DebugAddWatchpoint(stub->debugger, addr, size, watch_kind(type)) :
+                  DebugRemoveWatchpoint(stub->debugger, addr);
+  }
+  else
+  {
+    stub->reply[0] = '\0';
+    return;
+  }
+  strcpy(stub->reply, ok ? "OK" : "E01");
+}
+
+// Answer the packet in stub->packet, leaving the reply in stub->reply.
+static int handle_packet(GdbStub *stub, Machine *machine)
+{
+  CpuState *state = machine->state;
+  const char *p = stub->packet + 1;
+  char *out = stub->reply;
+  uint32_t addr, len, i;
+  uint16_t x;
+  int n;
+
+  *out = '\0';
+  switch (stub->packet[0])
+  {
+    case '?':
+      sprintf(out, "S%02x", stub->signal);
+      break;
+
+    case 'g':
+      for (n = 0; n < GDB_REGISTERS; n++)
+      {
+        out = put_register(out, get_register(state, n));
+      }
+      break;
+
+    case 'G':
+      for (n = 0; n < GDB_REGISTERS && parse_register(&p, &x); n++)
+      {
+        set_register(state, n, x);
+      }
+      strcpy(out, n == GDB_REGISTERS ? "OK" : "E01");
+      break;
+
+    case 'p':
+      n = parse_hex(&p);
+      if (n < GDB_REGISTERS)
+      {
+        put_register(out, get_register(state, n));
+      }
+      else
+      {
+        strcpy(out, n < GDB_Z80_REGISTERS ? "xxxx" : "E01");
+      }
+      break;
+
+    case 'P':
+      n = parse_hex(&p);
+      if (n < GDB_REGISTERS && *p++ == '=' && parse_register(&p, &x))
+      {
+        set_register(state, n, x);
+        strcpy(out, "OK");
+      }
+      else
+      {
+        strcpy(out, "E01");
+      }
+      break;
+
+    case 'm':
+      addr = parse_hex(&p);
+      len = *p == ',' ? (p++, parse_hex(&p)) : 0;
+      if (len > GDB_PACKET_SIZE / 2 - 1)
+      {
+        len = GDB_PACKET_SIZE / 2 - 1;
+      }
+      for (i = 0; i < len; i++)
+      {
+        out += sprintf(out, "%02x", state->memory[(uint16_t) (addr + i)]);
+      }
+      break;
+
+    case 'M':
+      addr = parse_hex(&p);
+      len = *p == ',' ? (p++, parse_hex(&p)) : 0;
+      if (*p++ != ':')
+      {
+        strcpy(out, "E01");
+        break;
+      }
+      for (i = 0; i < len && (n = parse_byte(&p)) >= 0; i++)
+      {
+        state->memory[(uint16_t) (addr + i)] = n;
+      }
+      strcpy(out, i == len ? "OK" : "E01");
+      break;
+
+    case 'c':
+    case 's':
+      if (hex_value(*p) >= 0)
+      {
+        state->pc = parse_hex(&p);
+      }
+      stub->debugger->steps = stub->packet[0] == 's' ? 1 : UINT64_MAX;
+      return GDB_RESUME;
+
+    case 'Z':
+    case 'z':
+      breakpoint_packet(stub, stub->packet);
+      break;
+
+    case 'D':
+      strcpy(out, "OK");
+      return GDB_DETACH;
+
+    case 'k':
+      return GDB_KILL;
+
+    case 'H':
+      strcpy(out, "OK");
+      break;
+
+    case 'q':
+      if (strncmp(p, "Supported", 9) == 0)
+      {
+        sprintf(out, "PacketSize=%x;QStartNoAckMode+", GDB_PACKET_SIZE);
+      }
+      else if (strcmp(p, "Attached") == 0)
+      {
+        //detach rather than kill when the client quits
+        strcpy(out, "1");
+      }
+      else if (strcmp(p, "C") == 0)
+      {
+        strcpy(out, "QC1");
+      }
+      else if (strcmp(p, "fThreadInfo") == 0)
+      {
+        strcpy(out, "m1");
+      }
+      else if (strcmp(p, "sThreadInfo") == 0)
+      {
+        strcpy(out, "l");
+      }
+      break;
+
+    case 'Q':
+      if (strcmp(p, "StartNoAckMode") == 0)
+      {
+        strcpy(out, "OK");
+      }
+      break;
+  }
+  return GDB_STOPPED;
+}
+
+// Answer packets while the target is stopped, until it resumes or the
+// client leaves.
+static int serve(GdbStub *stub, Machine *machine)
+{
+  for (;;)
+  {
+    if (get_packet(stub) < 0)
+    {
+      return GDB_DETACH;
+    }
+    int action = handle_packet(stub, machine);
+    if (action == GDB_RESUME || action == GDB_KILL)
+    {
+      return action;
+    }
+    if (put_packet(stub, stub->reply) < 0)
+    {
+      return GDB_DETACH;
+    }
+    if (strcmp(stub->packet, "QStartNoAckMode") == 0)
+    {
+      stub->no_ack = 1;
+    }
+    if (action == GDB_DETACH)
+    {
+      return action;
+    }
+  }
+}
+
+// Tell the client why the target stopped, then serve it until it resumes.
+static int report_stop(GdbStub *stub, Machine *machine, int signal)
+{
+  Debugger *debugger = stub->debugger;
+
+  stub->signal = signal;
+  if (signal == GDB_SIGTRAP && debugger->stop == DEBUG_WATCHPOINT)
+  {
+    // gdb expects data watchpoints to trigger after the access, so run the
+    // instruction before reporting it
+    Watchpoint watch = debugger->stop_watch;
+    uint16_t addr = debugger->stop_access.addr;
+    const char *name = watch.kind == ACCESS_WRITE ? "watch" :
+                       watch.kind == ACCESS_READ ? "rwatch" : "awatch";
+    if ((uint16_t) (addr - watch.addr) >= watch.size)
+    {
+      addr = watch.addr;
+    }
+    debugger->steps = 1;
+    while (MachineRunFrameDebug(machine, debugger))
+      ;
+    sprintf(stub->reply, "T%02x%s:%04x;", signal, name, addr);
+  }
+  else
+  {
+    sprintf(stub->reply, "S%02x", signal);
+  }
+
+  if (put_packet(stub, stub->reply) < 0)
+  {
+    return GDB_DETACH;
+  }
+  return serve(stub, machine);
+}
+
+void RunGdbStub(GdbStub *stub, Machine *machine)
+{
+  CpuState *state = machine->state;
+
+  for (;;)
+  {
+    int action;
+
+    if (stub->client_fd < 0)
+    {
+      if (machine->frames % GDB_ACCEPT_FRAMES == 0 && accept_client(stub))
+      {
+        //a new client finds the target stopped
+        stub->signal = GDB_SIGTRAP;
+        action = serve(stub, machine);
+      }
+      else if (MachineRunFrame(machine))
+      {
+        continue;
+      }
+      else
+      {
+        return;
+      }
+    }
+    else if (MachineRunFrameDebug(machine, stub->debugger))
+    {
+      int interrupt = poll_interrupt(stub);
+      if (interrupt == 0)
+      {
+        continue;
+      }
+      action = interrupt < 0 ? GDB_DETACH : report_stop(stub, machine, GDB_SIGINT);
+    }
+    else if (state->halted)
+    {
+      //an unimplemented instruction ends the run
+      char reply[8];
+      sprintf(reply, "X%02x", GDB_SIGILL);
+      put_packet(stub, reply);
+      detach(stub);
+      return;
+    }
+    else
+    {
+      action = report_stop(stub, machine, GDB_SIGTRAP);
+    }
+
+    if (action == GDB_KILL)
+    {
+      return;
+    }
+    if (action == GDB_DETACH)
+    {
+      detach(stub);
+    }
+  }
+}
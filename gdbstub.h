@@ -0,0 +1,50 @@
+#ifndef I8080_GDBSTUB_H
+#define I8080_GDBSTUB_H
+
+#include <stdint.h>
+
+#include "debug.h"
+
+// GDB remote serial protocol stub.
+//
+// Listens on a localhost TCP port or a Unix socket path. While no client is
+// attached the machine runs through the plain MachineRunFrame and the
+// listening socket is polled every GDB_ACCEPT_FRAMES frames, so detached
+// runs cost nothing per instruction. An attached client switches to
+// MachineRunFrameDebug: breakpoints, watchpoints and single steps use the
+// Debugger, and packets are only read at frame boundaries (for Ctrl-C) and
+// while the target is stopped.
+//
+// Registers are sent as af, bc, de, hl, sp, pc, 16 bits each, which is the
+// start of gdb's z80 register set; the flags byte uses the 8080 layout
+// S Z 0 AC 0 P 1 CY. gdb reports the z80 registers after pc unavailable.
+
+#define GDB_PACKET_SIZE   4096
+#define GDB_ACCEPT_FRAMES 30
+
+typedef struct {
+  int      listen_fd;
+  int      client_fd;     // -1 while detached
+  char     *path;         // Unix socket this stub bound, NULL for TCP
+  int      no_ack;        // client sent QStartNoAckMode
+  int      signal;        // signal in the last stop reply
+  Debugger *debugger;
+
+  uint8_t  in[GDB_PACKET_SIZE];
+  int      in_pos;
+  int      in_len;
+  char     packet[GDB_PACKET_SIZE];
+  char     reply[GDB_PACKET_SIZE];
+} GdbStub;
+
+// Listen on `address`: a port number for 127.0.0.1, anything else is a Unix
+// socket path; an existing file there is only replaced if it is a socket.
+// NULL with a message on error.
+GdbStub* CreateGdbStub(const char *address);
+void FreeGdbStub(GdbStub *stub);
+
+// Run the machine, serving clients as they attach, until the cpu halts or a
+// client kills the target.
+void RunGdbStub(GdbStub *stub, Machine *machine);
+
+#endif /* I8080_GDBSTUB_H */
@@ -0,0 +1,204 @@
+#include "heatmap.h"
+#include "access.h"
+
+// Map shades, from no traffic to the busiest page
+static const char heat_shades[] = " .:-=+*#%@";
+
+static const char *region_names[HEAT_REGIONS] = {
+  "rom", "work ram", "stack", "vram", "other"
+};
+
+Heatmap* CreateHeatmap(uint32_t frames, FILE *out)
+{
+  Heatmap *heatmap = calloc(1, sizeof(Heatmap));
+  heatmap->frames = frames ? frames : 1;
+  heatmap->out = out;
+  return heatmap;
+}
+
+void FreeHeatmap(Heatmap *heatmap)
+{
+  free(heatmap);
+}
+
+static inline void count_access(HeatCounts *counts, uint16_t start, int size,
+                                uint8_t kind, int stack)
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+  {
+    uint16_t addr = start + i;
+    int region = stack ? HEAT_STACK :
+                 addr < MACHINE_ROM_SIZE ? HEAT_ROM :
+                 addr < MACHINE_VRAM_START ? HEAT_WORK_RAM :
+                 addr < MACHINE_VRAM_START + MACHINE_VRAM_SIZE ? HEAT_VRAM : HEAT_OTHER;
+    if (kind & ACCESS_READ)
+    {
+      counts->reads[addr >> 8]++;
+      counts->region_reads[region]++;
+    }
+    if (kind & ACCESS_WRITE)
+    {
+      counts->writes[addr >> 8]++;
+      counts->region_writes[region]++;
+    }
+  }
+}
+
+static inline int heatmap_before(Machine *machine, Heatmap *heatmap)
+{
+  CpuState *state = machine->state;
+  MemoryAccess access;
+
+  if (!DecodeMemoryAccess(state, &access))
+  {
+    return HOOK_CONTINUE;
+  }
+  int stack = access.size == 2 && (access.addr == state->sp ||
+                                    access.addr == (uint16_t) (state->sp - 2));
+  count_access(&heatmap->interval, access.addr, access.size, access.kind, stack);
+  return HOOK_CONTINUE;
+}
+
+/* The interrupt has just pushed pc below the old sp */
+static inline int heatmap_interrupt(Machine *machine, Heatmap *heatmap)
+{
+  count_access(&heatmap->interval, machine->state->sp, 2, ACCESS_WRITE, 1);
+  return HOOK_CONTINUE;
+}
+
+static int heatmap_run_frame(Machine *machine, Heatmap *heatmap);
+
+DEFINE_MACHINE_RUN_FRAME(heatmap_run_frame, Heatmap,
+                         heatmap_before, no_machine_hook, heatmap_interrupt,
+                         no_machine_limit)
+
+static void dump_pages(FILE *out, uint64_t frame, const char *name,
+                       const uint64_t *pages)
+{
+  int i;
+
+  fprintf(out, "frame %llu %s", (unsigned long long) frame, name);
+  for (i = 0; i < HEAT_PAGES; i++)
+  {
+    fprintf(out, " %llu", (unsigned long long) pages[i]);
+  }
+  fprintf(out, "\n");
+}
+
+/* Add the interval into the totals and start a new one */
+static void end_interval(Heatmap *heatmap)
+{
+  HeatCounts *interval = &heatmap->interval;
+  HeatCounts *total = &heatmap->total;
+  int i;
+
+  for (i = 0; i < HEAT_PAGES; i++)
+  {
+    total->reads[i] += interval->reads[i];
+    total->writes[i] += interval->writes[i];
+  }
+  for (i = 0; i < HEAT_REGIONS; i++)
+  {
+    total->region_reads[i] += interval->region_reads[i];
+    total->region_writes[i] += interval->region_writes[i];
+  }
+  memset(interval, 0, sizeof(HeatCounts));
+  heatmap->pending = 0;
+}
+
+static void dump_interval(Heatmap *heatmap, uint64_t frame)
+{
+  HeatCounts *interval = &heatmap->interval;
+  int i;
+
+  fprintf(heatmap->out, "frame %llu regions", (unsigned long long) frame);
+  for (i = 0; i < HEAT_REGIONS; i++)
+  {
+    fprintf(heatmap->out, " %llu %llu", (unsigned long long) interval->region_reads[i],
+            (unsigned long long) interval->region_writes[i]);
+  }
+  fprintf(heatmap->out, "\n");
+  dump_pages(heatmap->out, frame, "reads", interval->reads);
+  dump_pages(heatmap->out, frame, "writes", interval->writes);
+}
+
+int MachineRunFrameHeatmap(Machine *machine, Heatmap *heatmap)
+{
+  uint64_t frames = machine->frames;
+  int ok = heatmap_run_frame(machine, heatmap);
+
+  if (machine->frames != frames && ++heatmap->pending >= heatmap->frames)
+  {
+    if (heatmap->out)
+    {
+      dump_interval(heatmap, machine->frames);
+    }
+    end_interval(heatmap);
+  }
+  return ok;
+}
+
+static int bit_length(uint64_t x)
+{
+  int n = 0;
+
+  while (x)
+  {
+    n++;
+    x >>= 1;
+  }
+  return n;
+}
+
+void PrintHeatmap(Heatmap *heatmap)
+{
+  HeatCounts *total = &heatmap->total;
+  uint64_t reads = 0, writes = 0, busiest = 0;
+  int i, row, col;
+
+  //a partial interval still counts
+  end_interval(heatmap);
+
+  for (i = 0; i < HEAT_REGIONS; i++)
+  {
+    reads += total->region_reads[i];
+    writes += total->region_writes[i];
+  }
+  printf("%-10s %14s %6s %14s %6s\n", "region", "bytes read", "share",
+         "bytes written", "share");
+  for (i = 0; i < HEAT_REGIONS; i++)
+  {
+    printf("%-10s %14llu %5.1f%% %14llu %5.1f%%\n", region_names[i],
+           (unsigned long long) total->region_reads[i],
+           reads ? 100.0 * total->region_reads[i] / reads : 0.0,
+           (unsigned long long) total->region_writes[i],
+           writes ? 100.0 * total->region_writes[i] / writes : 0.0);
+  }
+
+  // Shades on a log scale, so quiet pages still show against the stack
+  for (i = 0; i < HEAT_PAGES; i++)
+  {
+    if (total->reads[i] + total->writes[i] > busiest)
+    {
+      busiest = total->reads[i] + total->writes[i];
+    }
+  }
+  int top = bit_length(busiest);
+  int levels = sizeof(heat_shades) - 2;
+
+  printf("\npage traffic, '%c' none to '%c' busiest:\n", heat_shades[0], heat_shades[levels]);
+  printf("        0123456789abcdef  x $100\n");
+  for (row = 0; row < 16; row++)
+  {
+    printf("  $%x000 ", row);
+    for (col = 0; col < 16; col++)
+    {
+      uint64_t bytes = total->reads[row * 16 + col] + total->writes[row * 16 + col];
+      int level = bytes ? 1 + (levels - 1) * (bit_length(bytes) - 1) / (top > 1 ? top - 1 : 1) : 0;
+      putchar(heat_shades[level]);
+    }
+    printf("\n");
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef I8080_HEATMAP_H
+#define I8080_HEATMAP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// Memory access heatmap: bytes read and written per 256 byte page, and per
+// region. Only data accesses count, as found by DecodeMemoryAccess;
+// instruction fetches do not. Stack accesses are the 2 byte ones at sp
+// (PUSH, POP, CALL, RET, RST, XTHL), plus the pc pushed by each screen
+// interrupt, and count as the stack region wherever the stack is.
+//
+// There is no memory bus to hook, so counting has its own frame loop,
+// MachineRunFrameHeatmap, and costs nothing when it is not used.
+
+#define HEAT_PAGES 256
+
+// Regions
+#define HEAT_ROM      0   // below MACHINE_ROM_SIZE
+#define HEAT_WORK_RAM 1   // up to the start of video RAM
+#define HEAT_STACK    2
+#define HEAT_VRAM     3
+#define HEAT_OTHER    4   // above video RAM, mirrors on the real board
+#define HEAT_REGIONS  5
+
+typedef struct {
+  uint64_t reads[HEAT_PAGES];
+  uint64_t writes[HEAT_PAGES];
+  uint64_t region_reads[HEAT_REGIONS];
+  uint64_t region_writes[HEAT_REGIONS];
+} HeatCounts;
+
+typedef struct {
+  HeatCounts interval;    // since the last dump
+  HeatCounts total;
+  uint32_t   frames;      // frames per dump
+  uint32_t   pending;     // frames in the current interval
+  FILE       *out;        // dump file, NULL for none
+} Heatmap;
+
+// Dump the counts to `out` every `frames` frames, one line of regions and
+// one line each of page reads and writes:
+//   frame <n> regions <rom r> <rom w> <work r> <work w> <stack r> <stack w> ...
+//   frame <n> reads <page 0> ... <page 255>
+//   frame <n> writes <page 0> ... <page 255>
+Heatmap* CreateHeatmap(uint32_t frames, FILE *out);
+void FreeHeatmap(Heatmap *heatmap);
+
+// MachineRunFrame, counting memory accesses.
+int MachineRunFrameHeatmap(Machine *machine, Heatmap *heatmap);
+
+// Print the region totals and a 16x16 map of page traffic.
+void PrintHeatmap(Heatmap *heatmap);
+
+#endif /* I8080_HEATMAP_H */
@@ -0,0 +1,497 @@
+#include "lockstep.h"
+#include "disassembler.h"
+
+#define L LOCKSTEP_LANES
+
+// Instruction shapes that run across lanes at once
+enum {
+  VEC_NONE = 0,
+  VEC_NOP,
+  VEC_MOV,
+  VEC_MVI,
+  VEC_LXI,
+  VEC_INX,
+  VEC_INR,
+  VEC_DCR,
+  VEC_ALU,      // ADD..ORA r
+  VEC_ALU_IMM,  // ADI..CPI d8
+  VEC_JMP,
+  VEC_JCOND,
+};
+
+// ALU operation, bits 3-5 of the opcode
+enum { ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBB, ALU_ANA, ALU_XRA, ALU_ORA, ALU_CMP };
+
+static int vector_kind(uint8_t op)
+{
+  uint8_t ddd = (op >> 3) & 0x7;
+  uint8_t sss = op & 0x7;
+
+  switch (op)
+  {
+    case 0x00: case 0x08: case 0x10: case 0x18:
+    case 0x28: case 0x38: case 0xcb: case 0xd9:
+    case 0xdd: case 0xed: case 0xfd:
+      return VEC_NOP;
+    case 0xc3:
+      return VEC_JMP;
+    case 0xfe:
+      return VEC_ALU_IMM;
+  }
+
+  if ((op & 0xc0) == 0x40)
+  {
+    return (ddd == 6 || sss == 6) ? VEC_NONE : VEC_MOV;
+  }
+  if ((op & 0xc7) == 0x06)
+  {
+    return (ddd == 6) ? VEC_NONE : VEC_MVI;
+  }
+  if ((op & 0xcf) == 0x01)
+  {
+    return VEC_LXI;
+  }
+  if ((op & 0xcf) == 0x03)
+  {
+    return VEC_INX;
+  }
+  if ((op & 0xc7) == 0x04)
+  {
+    return (ddd == 6) ? VEC_NONE : VEC_INR;
+  }
+  if ((op & 0xc7) == 0x05)
+  {
+    return (ddd == 6) ? VEC_NONE : VEC_DCR;
+  }
+  //the scalar core has no CMP r yet, leave it to report the opcode
+  if ((op & 0xc0) == 0x80 && sss != 6 && ddd != ALU_CMP)
+  {
+    return VEC_ALU;
+  }
+  //ADI ACI SUI SBI ANI XRI ORI (CPI is matched above)
+  if ((op & 0xc7) == 0xc6)
+  {
+    return VEC_ALU_IMM;
+  }
+  if ((op & 0xc7) == 0xc2)
+  {
+    return VEC_JCOND;
+  }
+  return VEC_NONE;
+}
+
+/* Lane <-> CpuState transfer */
+static void lane_to_cpu(LockstepGroup *group, int i)
+{
+  CpuState *state = group->machine[i]->state;
+  state->b = group->reg[LOCKSTEP_REG_B][i];
+  state->c = group->reg[LOCKSTEP_REG_C][i];
+  state->d = group->reg[LOCKSTEP_REG_D][i];
+  state->e = group->reg[LOCKSTEP_REG_E][i];
+  state->h = group->reg[LOCKSTEP_REG_H][i];
+  state->l = group->reg[LOCKSTEP_REG_L][i];
+  state->a = group->reg[LOCKSTEP_REG_A][i];
+  state->sp = group->sp[i];
+  state->pc = group->pc[i];
+  state->cc.z = group->z[i];
+  state->cc.s = group->s[i];
+  state->cc.p = group->p[i];
+  state->cc.cy = group->cy[i];
+  state->cc.ac = group->ac[i];
+  state->int_enable = group->int_enable[i];
+  state->halted = group->halted[i];
+  state->cycles = group->cycles[i];
+}
+
+static void cpu_to_lane(LockstepGroup *group, int i)
+{
+  CpuState *state = group->machine[i]->state;
+  group->reg[LOCKSTEP_REG_B][i] = state->b;
+  group->reg[LOCKSTEP_REG_C][i] = state->c;
+  group->reg[LOCKSTEP_REG_D][i] = state->d;
+  group->reg[LOCKSTEP_REG_E][i] = state->e;
+  group->reg[LOCKSTEP_REG_H][i] = state->h;
+  group->reg[LOCKSTEP_REG_L][i] = state->l;
+  group->reg[LOCKSTEP_REG_A][i] = state->a;
+  group->sp[i] = state->sp;
+  group->pc[i] = state->pc;
+  group->z[i] = state->cc.z;
+  group->s[i] = state->cc.s;
+  group->p[i] = state->cc.p;
+  group->cy[i] = state->cc.cy;
+  group->ac[i] = state->cc.ac;
+  group->int_enable[i] = state->int_enable;
+  group->halted[i] = state->halted;
+  group->cycles[i] = state->cycles;
+}
+
+void LockstepLoad(LockstepGroup *group, Machine **machines, int lanes)
+{
+  int i;
+
+  memset(group, 0, sizeof(LockstepGroup));
+  group->lanes = (lanes > L) ? L : lanes;
+  for (i = 0; i < group->lanes; i++)
+  {
+    group->machine[i] = machines[i];
+    cpu_to_lane(group, i);
+  }
+  //unused lanes stay halted and are never stepped
+  for (; i < L; i++)
+  {
+    group->halted[i] = 1;
+  }
+}
+
+void LockstepStore(LockstepGroup *group)
+{
+  int i;
+  for (i = 0; i < group->lanes; i++)
+  {
+    lane_to_cpu(group, i);
+    group->machine[i]->instructions += group->instructions[i];
+    group->instructions[i] = 0;
+  }
+}
+
+static void scalar_step(LockstepGroup *group, int i)
+{
+  lane_to_cpu(group, i);
+  MachineStep(group->machine[i]);
+  cpu_to_lane(group, i);
+  group->scalar_steps++;
+}
+
+/* Set z, s, p on the masked lanes from an 8 bit result */
+static inline void zsp_flags(LockstepGroup *group, const uint8_t *mask,
+                             const uint8_t *res)
+{
+  int i;
+  for (i = 0; i < L; i++)
+  {
+    //parity by folding the bits, a table lookup would be a gather
+    uint8_t fold = res[i] ^ (res[i] >> 4);
+    fold ^= fold >> 2;
+    fold ^= fold >> 1;
+    group->z[i] = mask[i] ? (res[i] == 0) : group->z[i];
+    group->s[i] = mask[i] ? (res[i] >> 7) : group->s[i];
+    group->p[i] = mask[i] ? !(fold & 0x1) : group->p[i];
+  }
+}
+
+/* 8 bit ALU op on A, matching the arithmetic helpers of the scalar core */
+static void vector_alu(LockstepGroup *group, const uint8_t *mask, int alu,
+                       const uint8_t *x)
+{
+  uint8_t *a = group->reg[LOCKSTEP_REG_A];
+  const uint8_t *c = group->cy;
+  uint8_t res[L];
+  uint8_t cy[L];
+  int i;
+
+  //one branch-free loop per op, so each one vectorizes on its own
+#define ALU_LANES(answer) \
+  for (i = 0; i < L; i++) \
+  { \
+    uint16_t wide = (answer); \
+    res[i] = wide & 0xff; \
+    cy[i] = (wide > 0xff); \
+  }
+
+  //ADC/SUB/SBB take a signed operand in the scalar core
+  switch (alu)
+  {
+    case ALU_ADD: ALU_LANES(a[i] + (uint16_t) x[i]); break;
+    case ALU_ADC: ALU_LANES(a[i] + (uint16_t) (int8_t) x[i] + c[i]); break;
+    case ALU_SUB: ALU_LANES(a[i] - (uint16_t) (int8_t) x[i]); break;
+    case ALU_SBB: ALU_LANES(a[i] - (uint16_t) (int8_t) x[i] - c[i]); break;
+    case ALU_ANA: ALU_LANES(a[i] & x[i]); break;
+    case ALU_XRA: ALU_LANES(a[i] ^ x[i]); break;
+    case ALU_ORA: ALU_LANES(a[i] | x[i]); break;
+    default:      ALU_LANES(a[i] - (uint16_t) x[i]); break; //CMP
+  }
+#undef ALU_LANES
+
+  zsp_flags(group, mask, res);
+  for (i = 0; i < L; i++)
+  {
+    group->cy[i] = mask[i] ? cy[i] : group->cy[i];
+  }
+  if (alu != ALU_CMP)
+  {
+    for (i = 0; i < L; i++)
+    {
+      a[i] = mask[i] ? res[i] : a[i];
+    }
+  }
+}
+
+static void vector_condition(LockstepGroup *group, uint8_t ccc, uint8_t *cond)
+{
+  const uint8_t *flag;
+  int i;
+
+  switch (ccc >> 1)
+  {
+    case 0:  flag = group->z;  break;
+    case 1:  flag = group->cy; break;
+    case 2:  flag = group->p;  break;
+    default: flag = group->s;  break;
+  }
+  //even ccc tests for the flag clear, odd for set
+  for (i = 0; i < L; i++)
+  {
+    cond[i] = (flag[i] == (ccc & 0x1));
+  }
+}
+
+static void vector_execute(LockstepGroup *group, int kind, const uint8_t *op,
+                           const uint8_t *mask)
+{
+  uint8_t ddd = (op[0] >> 3) & 0x7;
+  uint8_t sss = op[0] & 0x7;
+  uint8_t rp = (op[0] >> 4) & 0x3;
+  uint8_t len = 1;
+  uint8_t cycles = opcodes8080[op[0]].cycles;
+  uint8_t x[L];
+  int i;
+
+  switch (kind)
+  {
+    case VEC_NOP:
+      break;
+
+    case VEC_MOV:
+      for (i = 0; i < L; i++)
+      {
+        group->reg[ddd][i] = mask[i] ? group->reg[sss][i] : group->reg[ddd][i];
+      }
+      break;
+
+    case VEC_MVI:
+      for (i = 0; i < L; i++)
+      {
+        group->reg[ddd][i] = mask[i] ? op[1] : group->reg[ddd][i];
+      }
+      len = 2;
+      break;
+
+    case VEC_LXI:
+      for (i = 0; i < L; i++)
+      {
+        if (rp == 0x3)
+        {
+          group->sp[i] = mask[i] ? ((op[2] << 8) | op[1]) : group->sp[i];
+        }
+        else
+        {
+          group->reg[rp * 2][i] = mask[i] ? op[2] : group->reg[rp * 2][i];
+          group->reg[rp * 2 + 1][i] = mask[i] ? op[1] : group->reg[rp * 2 + 1][i];
+        }
+      }
+      len = 3;
+      break;
+
+    case VEC_INX:
+      for (i = 0; i < L; i++)
+      {
+        if (rp == 0x3)
+        {
+          group->sp[i] += mask[i];
+        }
+        else
+        {
+          uint16_t pair = (group->reg[rp * 2][i] << 8) | group->reg[rp * 2 + 1][i];
+          pair += mask[i];
+          group->reg[rp * 2][i] = pair >> 8;
+          group->reg[rp * 2 + 1][i] = pair & 0xff;
+        }
+      }
+      break;
+
+    case VEC_INR:
+    case VEC_DCR:
+      for (i = 0; i < L; i++)
+      {
+        x[i] = group->reg[ddd][i] + ((kind == VEC_INR) ? 1 : -1);
+        group->reg[ddd][i] = mask[i] ? x[i] : group->reg[ddd][i];
+      }
+      zsp_flags(group, mask, x);
+      break;
+
+    case VEC_ALU:
+      vector_alu(group, mask, ddd, group->reg[sss]);
+      break;
+
+    case VEC_ALU_IMM:
+      memset(x, op[1], sizeof(x));
+      vector_alu(group, mask, ddd, x);
+      len = 2;
+      break;
+
+    case VEC_JMP:
+      for (i = 0; i < L; i++)
+      {
+        group->pc[i] = mask[i] ? ((op[2] << 8) | op[1]) : group->pc[i];
+      }
+      len = 0;
+      break;
+
+    case VEC_JCOND:
+      vector_condition(group, ddd, x);
+      for (i = 0; i < L; i++)
+      {
+        uint16_t next = x[i] ? ((op[2] << 8) | op[1]) : group->pc[i] + 3;
+        group->pc[i] = mask[i] ? next : group->pc[i];
+      }
+      len = 0;
+      break;
+  }
+
+  //one loop per element width
+  for (i = 0; i < L; i++)
+  {
+    group->pc[i] += mask[i] ? len : 0;
+  }
+  for (i = 0; i < L; i++)
+  {
+    group->cycles[i] += mask[i] ? cycles : 0;
+    group->instructions[i] += mask[i];
+  }
+  group->vector_steps++;
+}
+
+/* Advance every eligible lane by one instruction */
+static void lockstep_step(LockstepGroup *group, const uint8_t *eligible)
+{
+  uint8_t mask[L];
+  int leader = -1;
+  int i;
+
+  for (i = 0; i < L && leader < 0; i++)
+  {
+    if (eligible[i])
+    {
+      leader = i;
+    }
+  }
+  if (leader < 0)
+  {
+    return;
+  }
+
+  //lanes that agree with the leader on pc and instruction bytes
+  uint16_t pc = group->pc[leader];
+  uint8_t *op = &group->machine[leader]->state->memory[pc];
+  int kind = vector_kind(op[0]);
+
+  for (i = 0; i < L; i++)
+  {
+    mask[i] = 0;
+    if (kind != VEC_NONE && eligible[i] && group->pc[i] == pc)
+    {
+      uint8_t *lane_op = &group->machine[i]->state->memory[pc];
+      mask[i] = (lane_op[0] == op[0]) && (lane_op[1] == op[1]) &&
+                (lane_op[2] == op[2]);
+    }
+  }
+
+  if (kind != VEC_NONE)
+  {
+    vector_execute(group, kind, op, mask);
+  }
+
+  for (i = 0; i < L; i++)
+  {
+    if (eligible[i] && !mask[i])
+    {
+      scalar_step(group, i);
+    }
+  }
+}
+
+static void run_until(LockstepGroup *group, const uint64_t *target)
+{
+  uint8_t eligible[L];
+  int any = 1;
+  int i;
+
+  while (any)
+  {
+    any = 0;
+    for (i = 0; i < L; i++)
+    {
+      eligible[i] = !group->halted[i] && group->cycles[i] < target[i];
+      any |= eligible[i];
+    }
+    if (any)
+    {
+      lockstep_step(group, eligible);
+    }
+  }
+}
+
+static void lane_interrupt(LockstepGroup *group, int i, int n)
+{
+  uint8_t *memory = group->machine[i]->state->memory;
+  uint16_t sp = group->sp[i];
+  memory[(uint16_t) (sp - 1)] = (group->pc[i] >> 8) & 0xff;
+  memory[(uint16_t) (sp - 2)] = group->pc[i] & 0xff;
+  group->sp[i] = sp - 2;
+  group->pc[i] = 8 * n;
+  group->int_enable[i] = 0;
+}
+
+void LockstepRunFrame(LockstepGroup *group)
+{
+  uint64_t target[L];
+  uint64_t start[L];
+  uint8_t first[L];
+  int half, i;
+
+  memcpy(start, group->cycles, sizeof(start));
+  memset(first, 1, sizeof(first));
+  for (i = 0; i < group->lanes; i++)
+  {
+    //pick up a frame another frame loop stopped part way, as it would
+    Machine *machine = group->machine[i];
+    if (machine->frame_irq)
+    {
+      start[i] = machine->frame_start;
+      first[i] = machine->frame_irq;
+      machine->frame_irq = 0;
+    }
+  }
+
+  for (half = 1; half <= 2; half++)
+  {
+    for (i = 0; i < L; i++)
+    {
+      //a lane past this interrupt already has nothing to run
+      target[i] = (half < first[i]) ? 0 :
+                  start[i] + ((half == 1) ? MACHINE_CYCLES_PER_FRAME / 2 :
+                                            MACHINE_CYCLES_PER_FRAME);
+    }
+    run_until(group, target);
+
+    //RST 1 at mid-screen, RST 2 at vblank
+    for (i = 0; i < group->lanes; i++)
+    {
+      if (half >= first[i] && !group->halted[i] && group->int_enable[i])
+      {
+        lane_interrupt(group, i, half);
+        group->machine[i]->interrupts++;
+      }
+    }
+  }
+
+  for (i = 0; i < group->lanes; i++)
+  {
+    if (!group->halted[i])
+    {
+      //the input log hashes the machine, so it needs the lane's state
+      lane_to_cpu(group, i);
+      MachineEndFrame(group->machine[i]);
+    }
+  }
+}
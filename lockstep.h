@@ -0,0 +1,61 @@
+#ifndef I8080_LOCKSTEP_H
+#define I8080_LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+// Experimental structure-of-arrays engine: one lane per machine.
+//
+// When every lane sits on the same pc with the same instruction bytes, and
+// the instruction only touches registers, flags and pc, it is executed for
+// all lanes at once by branch-free loops over the lane arrays. gcc -O2
+// vectorizes the ALU, flag, INR/DCR and pc loops; -fopt-info-vec lists
+// them. emubench's invaders_lockstep workload measures the group against
+// the same machines run one by one and checks they end up identical.
+// Lanes whose pc diverged are masked out of the vector step and advanced by
+// the scalar core instead, so the group stays correct and can reconverge.
+#define LOCKSTEP_LANES 16
+
+// Register index in reg[], same encoding as the SSS/DDD opcode fields
+#define LOCKSTEP_REG_B 0
+#define LOCKSTEP_REG_C 1
+#define LOCKSTEP_REG_D 2
+#define LOCKSTEP_REG_E 3
+#define LOCKSTEP_REG_H 4
+#define LOCKSTEP_REG_L 5
+#define LOCKSTEP_REG_A 7
+
+typedef struct {
+  int      lanes;
+  uint8_t  reg[8][LOCKSTEP_LANES];
+  uint16_t sp[LOCKSTEP_LANES];
+  uint16_t pc[LOCKSTEP_LANES];
+  uint8_t  z[LOCKSTEP_LANES];
+  uint8_t  s[LOCKSTEP_LANES];
+  uint8_t  p[LOCKSTEP_LANES];
+  uint8_t  cy[LOCKSTEP_LANES];
+  uint8_t  ac[LOCKSTEP_LANES];
+  uint8_t  int_enable[LOCKSTEP_LANES];
+  uint8_t  halted[LOCKSTEP_LANES];
+  uint64_t cycles[LOCKSTEP_LANES];
+  uint64_t instructions[LOCKSTEP_LANES];   // vector steps, not yet in the machine
+  Machine  *machine[LOCKSTEP_LANES];
+
+  uint64_t vector_steps;   // instructions run across lanes at once
+  uint64_t scalar_steps;   // per-lane instructions run by the scalar core
+} LockstepGroup;
+
+// Gather up to LOCKSTEP_LANES machines into a group.
+void LockstepLoad(LockstepGroup *group, Machine **machines, int lanes);
+
+// Scatter lane state back into each machine's CpuState, and add the
+// instructions run by vector steps to machine->instructions.
+void LockstepStore(LockstepGroup *group);
+
+// Run one video frame on every lane, like MachineRunFrame: a frame another
+// frame loop stopped part way is finished, interrupts taken are counted and
+// each frame ends with MachineEndFrame, so input logs get their markers.
+void LockstepRunFrame(LockstepGroup *group);
+
+#endif /* I8080_LOCKSTEP_H */
@@ -0,0 +1,245 @@
+#include "machine.h"
+#include "replay.h"
+
+static void load_rom(CpuState *state)
+{
+  ReadFileIntoMemoryAt(state, "invaders.h", 0);
+  ReadFileIntoMemoryAt(state, "invaders.g", 0x800);
+  ReadFileIntoMemoryAt(state, "invaders.f", 0x1000);
+  ReadFileIntoMemoryAt(state, "invaders.e", 0x1800);
+}
+
+Machine* InitMachine(void)
+{
+  Machine *machine = calloc(1, sizeof(Machine));
+  machine->state = Init8080();
+  load_rom(machine->state);
+
+  //port 1 bit 3 is always 1
+  machine->in_port1 = 0x08;
+  return machine;
+}
+
+CpuPool* CreateMachinePool(int capacity, int huge_pages)
+{
+  CpuPool *pool = CreateCpuPool(capacity, huge_pages);
+  CpuState *rom = Init8080();
+
+  load_rom(rom);
+  PoolSetImage(pool, rom->memory, MACHINE_ROM_SIZE);
+  Free8080(rom);
+  return pool;
+}
+
+Machine* InitMachineFromPool(CpuPool *pool)
+{
+  CpuState *state = PoolAcquire8080(pool);
+  if (state == NULL)
+  {
+    return NULL;
+  }
+
+  Machine *machine = PoolMachine(pool, state);
+  machine->state = state;
+  machine->pool = pool;
+  machine->in_port1 = 0x08;
+  return machine;
+}
+
+void FreeMachine(Machine *machine)
+{
+  if (machine->pool)
+  {
+    //the machine lives in the pool next to its cpu
+    PoolRelease8080(machine->pool, machine->state);
+    return;
+  }
+  Free8080(machine->state);
+  free(machine);
+}
+
+void GenerateInterrupt(CpuState *state, int n)
+{
+  state->memory[state->sp - 1] = (state->pc >> 8) & 0xff;
+  state->memory[state->sp - 2] = (state->pc & 0xff);
+  state->sp = state->sp - 2;
+  state->pc = 8 * n;
+  state->int_enable = 0;
+}
+
+static uint8_t MachineIn(Machine *machine, uint8_t port)
+{
+  uint8_t value;
+
+  switch (port)
+  {
+    case 1:
+      value = machine->in_port1;
+      break;
+    case 2:
+      value = machine->in_port2;
+      break;
+    case 3:
+      //shift register result
+      value = (machine->shift_register >> (8 - machine->shift_offset)) & 0xff;
+      break;
+    default:
+      value = 0;
+      break;
+  }
+
+  if (machine->log)
+  {
+    value = InputLogRead(machine->log, machine, port, value);
+  }
+  return value;
+}
+
+static void MachineOut(Machine *machine, uint8_t port, uint8_t value)
+{
+  switch (port)
+  {
+    case 2:
+      machine->shift_offset = value & 0x7;
+      break;
+    case 4:
+      machine->shift_register = (value << 8) | (machine->shift_register >> 8);
+      break;
+    default:
+      //sound and watchdog ports are ignored
+      break;
+  }
+}
+
+void MachineStep(Machine *machine)
+{
+  CpuState *state = machine->state;
+  uint8_t *opcode = &state->memory[state->pc];
+
+  machine->instructions++;
+  if (*opcode == 0xdb) //IN
+  {
+    state->a = MachineIn(machine, opcode[1]);
+    state->pc += 2;
+    state->cycles += 10;
+  }
+  else if (*opcode == 0xd3) //OUT
+  {
+    MachineOut(machine, opcode[1], state->a);
+    state->pc += 2;
+    state->cycles += 10;
+  }
+  else
+  {
+    Emulate8080Op(state);
+  }
+}
+
+void MachineEndFrame(Machine *machine)
+{
+  machine->frames++;
+  if (machine->log)
+  {
+    InputLogFrame(machine->log, machine);
+  }
+}
+
+static DEFINE_MACHINE_RUN_FRAME(machine_run_frame, void, no_machine_hook,
+                                no_machine_hook, no_machine_hook,
+                                no_machine_limit)
+
+int MachineRunFrame(Machine *machine)
+{
+  return machine_run_frame(machine, NULL);
+}
+
+static uint32_t bcd_to_bin(uint8_t x)
+{
+  return (x >> 4) * 10 + (x & 0xf);
+}
+
+uint32_t MachineScore(Machine *machine)
+{
+  uint8_t *score = &machine->state->memory[MACHINE_SCORE_P1];
+  return bcd_to_bin(score[1]) * 100 + bcd_to_bin(score[0]);
+}
+
+static void put_u64_le(uint8_t *buffer, uint64_t x)
+{
+  int i;
+  for (i = 0; i < 8; i++)
+  {
+    buffer[i] = (x >> (8 * i)) & 0xff;
+  }
+}
+
+static uint64_t get_u64_le(const uint8_t *buffer)
+{
+  uint64_t x = 0;
+  int i;
+  for (i = 0; i < 8; i++)
+  {
+    x |= (uint64_t) buffer[i] << (8 * i);
+  }
+  return x;
+}
+
+void MachineSaveSnapshot(Machine *machine, uint8_t *buffer)
+{
+  CpuState *state = machine->state;
+
+  memset(buffer, 0, 40);
+  buffer[0] = state->a;
+  buffer[1] = state->b;
+  buffer[2] = state->c;
+  buffer[3] = state->d;
+  buffer[4] = state->e;
+  buffer[5] = state->h;
+  buffer[6] = state->l;
+  buffer[7] = state->cc.z | state->cc.s << 1 | state->cc.p << 2 |
+              state->cc.cy << 3 | state->cc.ac << 4;
+  buffer[8] = state->sp & 0xff;
+  buffer[9] = state->sp >> 8;
+  buffer[10] = state->pc & 0xff;
+  buffer[11] = state->pc >> 8;
+  buffer[12] = state->int_enable;
+  buffer[13] = state->halted;
+  buffer[MACHINE_SNAPSHOT_PORTS] = machine->in_port1;
+  buffer[MACHINE_SNAPSHOT_PORTS + 1] = machine->in_port2;
+  buffer[16] = machine->shift_register & 0xff;
+  buffer[17] = machine->shift_register >> 8;
+  buffer[18] = machine->shift_offset;
+  //bytes 19..23 are reserved
+  put_u64_le(&buffer[24], state->cycles);
+  put_u64_le(&buffer[32], machine->frames);
+  memcpy(&buffer[40], state->memory, I8080_MEMORY_SIZE);
+}
+
+void MachineLoadSnapshot(Machine *machine, const uint8_t *buffer)
+{
+  CpuState *state = machine->state;
+
+  state->a = buffer[0];
+  state->b = buffer[1];
+  state->c = buffer[2];
+  state->d = buffer[3];
+  state->e = buffer[4];
+  state->h = buffer[5];
+  state->l = buffer[6];
+  state->cc.z  = (buffer[7] >> 0) & 0x1;
+  state->cc.s  = (buffer[7] >> 1) & 0x1;
+  state->cc.p  = (buffer[7] >> 2) & 0x1;
+  state->cc.cy = (buffer[7] >> 3) & 0x1;
+  state->cc.ac = (buffer[7] >> 4) & 0x1;
+  state->sp = buffer[8] | (buffer[9] << 8);
+  state->pc = buffer[10] | (buffer[11] << 8);
+  state->int_enable = buffer[12];
+  state->halted = buffer[13];
+  machine->in_port1 = buffer[MACHINE_SNAPSHOT_PORTS];
+  machine->in_port2 = buffer[MACHINE_SNAPSHOT_PORTS + 1];
+  machine->shift_register = buffer[16] | (buffer[17] << 8);
+  machine->shift_offset = buffer[18];
+  state->cycles = get_u64_le(&buffer[24]);
+  machine->frames = get_u64_le(&buffer[32]);
+  memcpy(state->memory, &buffer[40], I8080_MEMORY_SIZE);
+}
@@ -0,0 +1,184 @@
+#ifndef I8080_MACHINE_H
+#define I8080_MACHINE_H
+
+#include <stdint.h>
+
+#include "emulator.h"
+#include "pool.h"
+#include "runloop.h"
+
+// Space Invaders runs the 8080 at 2MHz and refreshes the screen at 60Hz.
+// It gets RST 1 when the beam reaches mid-screen and RST 2 at vblank.
+#define MACHINE_CLOCK_HZ         2000000
+#define MACHINE_FRAMES_PER_SEC   60
+#define MACHINE_CYCLES_PER_FRAME (MACHINE_CLOCK_HZ / MACHINE_FRAMES_PER_SEC)
+
+// ROM: invaders.h, g, f and e, 2KB each
+#define MACHINE_ROM_SIZE   0x2000
+
+// Video RAM: 256x224 pixels, 1 bit per pixel, rotated
+#define MACHINE_VRAM_START 0x2400
+#define MACHINE_VRAM_SIZE  0x1c00
+
+// Player 1 score, 2 BCD bytes (low byte first)
+#define MACHINE_SCORE_P1   0x20f8
+
+// Input port 1 bits
+#define MACHINE_IN1_COIN     0x01
+#define MACHINE_IN1_P2_START 0x02
+#define MACHINE_IN1_P1_START 0x04
+#define MACHINE_IN1_P1_SHOT  0x10
+#define MACHINE_IN1_P1_LEFT  0x20
+#define MACHINE_IN1_P1_RIGHT 0x40
+
+typedef struct InputLog InputLog;
+typedef struct Coverage Coverage;
+typedef struct Sampler Sampler;
+
+// Space Invaders cabinet: a cpu plus the I/O hardware around it.
+struct Machine {
+  CpuState *state;
+  CpuPool  *pool;      // owner of state, NULL when it came from Init8080
+  uint8_t  in_port1;
+  uint8_t  in_port2;
+  uint16_t shift_register;
+  uint8_t  shift_offset;
+  uint64_t frames;
+  uint64_t instructions;
+  uint64_t interrupts;  // taken, not counting ones masked by DI
+  InputLog *log;       // records or replays port reads when set
+  Coverage *coverage;  // recorded by RunFleet when set
+  Sampler  *sampler;   // sampled by RunFleet when set
+
+  // where a frame loop stopped by a hook resumes
+  uint64_t frame_start;
+  uint8_t  frame_irq;  // next interrupt, 0 when no frame is in progress
+};
+
+// Allocate a machine and load the invaders ROM into it.
+Machine* InitMachine(void);
+// Pool of `capacity` machines holding the invaders ROM, read once here.
+CpuPool* CreateMachinePool(int capacity, int huge_pages);
+// Same as InitMachine, with the machine and cpu taken from a pool made by
+// CreateMachinePool and the ROM copied from it. NULL when it is exhausted.
+Machine* InitMachineFromPool(CpuPool *pool);
+void FreeMachine(Machine *machine);
+
+// Execute one instruction, routing IN/OUT to the cabinet hardware.
+void MachineStep(Machine *machine);
+
+// Run one 1/60s video frame including both screen interrupts.
+//   @return: 0 if the cpu halted on an unimplemented instruction
+int MachineRunFrame(Machine *machine);
+
+// Frame bookkeeping after the vblank interrupt: frame count and input log.
+void MachineEndFrame(Machine *machine);
+
+// Frame loops are generated per mode like the cpu run loops in runloop.h:
+// `before` and `after` are static inline hooks taking (Machine*, ctx_type*)
+// and returning HOOK_*, so an instrumented frame costs the plain one nothing.
+// `interrupt` is called the same way right after an interrupt was taken.
+// `limit` takes (Machine*, ctx_type*, uint64_t end) before each run of
+// instructions, including one last time once `end` is reached, and returns
+// the cycle count the run stops at: `end`, or an earlier point where it has
+// work to do on its next call. It must move past the current cycle count.
+// Defines `int name(Machine *machine, ctx_type *ctx)`, which returns 1 when
+// the frame completed and 0 when the cpu halted or a hook stopped it. A
+// stopped frame is picked up where it left off by the next frame loop call.
+#define DEFINE_MACHINE_RUN_FRAME(name, ctx_type, before, after, interrupt, limit) \
+  int name(Machine *machine, ctx_type *ctx)                              \
+  {                                                                      \
+    CpuState *state = machine->state;                                    \
+    uint64_t start = state->cycles;                                      \
+    int irq = 1;                                                         \
+    if (machine->frame_irq)                                              \
+    {                                                                    \
+      start = machine->frame_start;                                      \
+      irq = machine->frame_irq;                                          \
+      machine->frame_irq = 0;                                            \
+    }                                                                    \
+    for (; irq <= 2; irq++)                                              \
+    {                                                                    \
+      uint64_t end = start + (irq == 1 ? MACHINE_CYCLES_PER_FRAME / 2    \
+                                       : MACHINE_CYCLES_PER_FRAME);      \
+      for (;;)                                                           \
+      {                                                                  \
+        uint64_t bound = limit(machine, ctx, end);                       \
+        if (state->cycles >= end)                                        \
+        {                                                                \
+          break;                                                         \
+        }                                                                \
+        while (state->cycles < bound)                                    \
+        {                                                                \
+          int hook = before(machine, ctx);                               \
+          if (hook == HOOK_STOP)                                         \
+          {                                                              \
+            goto stop;                                                   \
+          }                                                              \
+          if (hook == HOOK_CONTINUE)                                     \
+          {                                                              \
+            MachineStep(machine);                                        \
+          }                                                              \
+          if (after(machine, ctx) == HOOK_STOP && !state->halted)        \
+          {                                                              \
+            goto stop;                                                   \
+          }                                                              \
+          if (state->halted)                                             \
+          {                                                              \
+            return 0;                                                    \
+          }                                                              \
+        }                                                                \
+      }                                                                  \
+      if (state->int_enable)                                             \
+      {                                                                  \
+        GenerateInterrupt(state, irq);                                   \
+        machine->interrupts++;                                           \
+        if (interrupt(machine, ctx) == HOOK_STOP)                        \
+        {                                                                \
+          irq++;                                                         \
+          goto stop;                                                     \
+        }                                                                \
+      }                                                                  \
+    }                                                                    \
+    MachineEndFrame(machine);                                            \
+    return 1;                                                            \
+  stop:                                                                  \
+    if (irq > 2)                                                         \
+    {                                                                    \
+      MachineEndFrame(machine);                                          \
+      return 0;                                                          \
+    }                                                                    \
+    machine->frame_start = start;                                        \
+    machine->frame_irq = irq;                                            \
+    return 0;                                                            \
+  }
+
+// Frame hook that does nothing
+static inline int no_machine_hook(Machine *machine, void *ctx)
+{
+  return HOOK_CONTINUE;
+}
+
+// Frame limit that runs straight to the interrupt
+static inline uint64_t no_machine_limit(Machine *machine, void *ctx, uint64_t end)
+{
+  return end;
+}
+
+// Push pc and jump to the RST n vector, like the interrupt controller does.
+void GenerateInterrupt(CpuState *state, int n);
+
+// Player 1 score decoded from BCD
+uint32_t MachineScore(Machine *machine);
+
+// Serialized machine: registers, cabinet I/O state, frame count and RAM
+#define MACHINE_SNAPSHOT_SIZE (40 + I8080_MEMORY_SIZE)
+// in_port1 and in_port2, which a replay feeds from the log instead
+#define MACHINE_SNAPSHOT_PORTS 14
+
+// Save or restore everything needed to resume a machine exactly.
+//   buffer: MACHINE_SNAPSHOT_SIZE bytes
+void MachineSaveSnapshot(Machine *machine, uint8_t *buffer);
+void MachineLoadSnapshot(Machine *machine, const uint8_t *buffer);
+
+#endif /* I8080_MACHINE_H */
@@ -1,37 +1,88 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "cfg.h"
 #include "disassembler.h"
 #include "emulator.h"
 
+static void usage(void)
+{
+  printf("usage: disasm [--flow | --dot] <file> [entry...]\n"
+         "  list the image from address 0 straight through, or\n"
+         "  --flow  follow the code from the reset and RST vectors and the hex\n"
+         "          entry addresses: basic blocks, labels and cross-references\n"
+         "  --dot   the same control flow graph for graphviz\n");
+}
+
 int main (int argc, char**argv)
 {
-  FILE *f = fopen(argv[1], "rb");
+  int flow = 0;
+  int arg = 1;
+
+  if (argc > 1 && (strcmp(argv[1], "--flow") == 0 || strcmp(argv[1], "--dot") == 0))
+  {
+    flow = (argv[1][2] == 'f') ? 1 : 2;
+    arg++;
+  }
+  if (arg >= argc || argv[arg][0] == '-' || (!flow && argc > arg + 1) ||
+      argc - arg - 1 > CFG_MAX_ENTRIES)
+  {
+    usage();
+    return 1;
+  }
+
+  FILE *f = fopen(argv[arg], "rb");
   if (f == NULL)
   {
-      printf("error: Couldn't open %s\n", argv[1]);
+      printf("error: Couldn't open %s\n", argv[arg]);
       exit(1);
   }
-  
+
   // Get the file size and read it into a memory buffer
   fseek(f, 0L, SEEK_END);
   int fsize = ftell(f);
   fseek(f, 0L, SEEK_SET);
 
-  unsigned char *buffer=malloc(fsize);
-  
+  // a whole address space, so operands of a cut off last instruction read 0
+  if (fsize > I8080_MEMORY_SIZE)
+  {
+    fsize = I8080_MEMORY_SIZE;
+  }
+  unsigned char *buffer=calloc(I8080_MEMORY_SIZE + 2, 1);
+
   fread(buffer, fsize, 1, f);
   fclose(f);
 
-  // Go through file and execute commands
-  int pc = 0;
-  
+  if (flow)
+  {
+    uint16_t entries[CFG_MAX_ENTRIES];
+    int num_entries = 0;
+
+    for (arg++; arg < argc; arg++)
+    {
+      entries[num_entries++] = strtol(argv[arg], NULL, 16);
+    }
+    Cfg *cfg = BuildCfg(buffer, fsize, entries, num_entries);
+    if (flow == 1)
+    {
+      PrintCfgListing(cfg, stdout);
+    }
+    else
+    {
+      WriteCfgDot(cfg, stdout);
+    }
+    FreeCfg(cfg);
+    return 0;
+  }
+
+  // Go through file a buffer full of lines at a time
+  static char out[1 << 16];
+  uint32_t pc = 0;
+
   while (pc < fsize)
   {
-#ifdef DEBUG_EN
-    printf("%d\n", pc);
-#endif
-    pc += Disassemble8080Op(buffer, pc);
+    size_t length = Disassemble8080Range(buffer, &pc, fsize, out, sizeof(out));
+    fwrite(out, 1, length, stdout);
   }
   return 0;
 }
@@ -1,73 +1,480 @@
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "emulator.h"
+#include "callgraph.h"
+#include "counters.h"
+#include "coverage.h"
+#include "cpm.h"
+#include "difftest.h"
+#include "fleet.h"
+#include "heatmap.h"
+#include "gdbstub.h"
+#include "monitor.h"
+#include "profile.h"
+#include "runloop.h"
+#include "replay.h"
+#include "sampler.h"
+#include "trace.h"
 
-int main (int argc, char** argv)
+// Instructions between RAM compares in the differential run
+#define DIFF_CHECK_INTERVAL 4096
+
+// Frames between state hashes and snapshots in recorded sessions
+#define RECORD_HASH_INTERVAL     60
+#define RECORD_SNAPSHOT_INTERVAL 600
+
+// Lines in each section of the profile report
+#define PROFILE_TOP 20
+
+// Run a fleet of invaders machines for a number of frames each
+static int run_fleet(int count, uint32_t frames)
+{
+  Machine **machines = malloc(count * sizeof(Machine*));
+  uint32_t *budget = malloc(count * sizeof(uint32_t));
+  int workers = FleetNumCores();
+  FleetWorkerStats *stats = calloc(workers, sizeof(FleetWorkerStats));
+  CpuPool *pool = CreateMachinePool(count, 1);
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    machines[i] = InitMachineFromPool(pool);
+    budget[i] = frames;
+  }
+
+  RunFleet(machines, budget, count, workers, MACHINE_FRAMES_PER_SEC, stats);
+  PrintFleetStats(stats, workers);
+
+  for (i = 0; i < count; i++)
+  {
+    FreeMachine(machines[i]);
+  }
+  DestroyCpuPool(pool);
+  free(stats);
+  free(budget);
+  free(machines);
+  return 0;
+}
+
+// Run a fleet recording coverage, then report ROM coverage of all machines
+static int coverage_session(int count, uint32_t frames)
+{
+  Machine **machines = malloc(count * sizeof(Machine*));
+  uint32_t *budget = malloc(count * sizeof(uint32_t));
+  CpuPool *pool = CreateMachinePool(count, 1);
+  Coverage *total = CreateCoverage();
+  uint32_t seed = 8080;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    machines[i] = InitMachineFromPool(pool);
+    machines[i]->coverage = CreateCoverage();
+    budget[i] = frames;
+
+    //each machine holds its own joystick input, the first one none
+    if (i > 0)
+    {
+      seed = seed * 1103515245 + 12345;
+      machines[i]->in_port1 = 0x08 | ((seed >> 16) & 0x75);
+    }
+  }
+
+  RunFleet(machines, budget, count, 0, MACHINE_FRAMES_PER_SEC, NULL);
+
+  for (i = 0; i < count; i++)
+  {
+    MergeCoverage(total, machines[i]->coverage);
+  }
+  PrintCoverage(total, machines[0]->state->memory, 0, MACHINE_ROM_SIZE);
+
+  for (i = 0; i < count; i++)
+  {
+    FreeCoverage(machines[i]->coverage);
+    FreeMachine(machines[i]);
+  }
+  FreeCoverage(total);
+  DestroyCpuPool(pool);
+  free(budget);
+  free(machines);
+  return 0;
+}
+
+// Sample a fleet every `interval` cycles, merge the samples and report
+static int sample_session(int count, uint32_t frames, uint32_t interval,
+                          const char *filename)
+{
+  FILE *out = fopen(filename, "w");
+  if (out == NULL)
+  {
+    printf("error: cannot write %s\n", filename);
+    return 1;
+  }
+
+  Machine **machines = malloc(count * sizeof(Machine*));
+  uint32_t *budget = malloc(count * sizeof(uint32_t));
+  CpuPool *pool = CreateMachinePool(count, 1);
+  Sampler *total = CreateSampler(interval, 0);
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    machines[i] = InitMachineFromPool(pool);
+    machines[i]->sampler = CreateSampler(interval, i + 1);
+    budget[i] = frames;
+  }
+
+  RunFleet(machines, budget, count, 0, MACHINE_FRAMES_PER_SEC, NULL);
+
+  for (i = 0; i < count; i++)
+  {
+    MergeSamples(total, machines[i]->sampler);
+    FreeSampler(machines[i]->sampler);
+    FreeMachine(machines[i]);
+  }
+  WriteSampleStacks(total, out);
+  fclose(out);
+  PrintSamples(total, PROFILE_TOP);
+
+  FreeSampler(total);
+  DestroyCpuPool(pool);
+  free(budget);
+  free(machines);
+  return 0;
+}
+
+// Record a session driven by a fixed pseudo random joystick script
+static int record_session(const char *filename, uint32_t frames)
+{
+  Machine *machine = InitMachine();
+  InputLog *log = CreateInputLog(RECORD_HASH_INTERVAL, RECORD_SNAPSHOT_INTERVAL);
+  uint32_t seed = 8080;
+  uint32_t f;
+
+  InputLogAttach(log, machine);
+  for (f = 0; f < frames && !machine->state->halted; f++)
+  {
+    if (f % 30 == 0)
+    {
+      seed = seed * 1103515245 + 12345;
+      machine->in_port1 = 0x08 | ((seed >> 16) & 0x75);
+    }
+    MachineRunFrame(machine);
+  }
+
+  int ok = SaveInputLog(log, filename);
+  printf("recorded %llu frames, %zu bytes\n",
+         (unsigned long long) log->frames, log->size);
+  FreeInputLog(log);
+  FreeMachine(machine);
+  return ok ? 0 : 1;
+}
+
+static int replay_session(const char *filename, int parallel)
+{
+  InputLog *log = LoadInputLog(filename);
+  if (log == NULL)
+  {
+    return 1;
+  }
+
+  int ok;
+  if (parallel)
+  {
+    ok = ReplayInputLogParallel(log, 0);
+  }
+  else
+  {
+    Machine *machine = InitMachine();
+    ok = ReplayInputLog(log, machine);
+    FreeMachine(machine);
+  }
+  printf("replayed %llu frames: %s\n", (unsigned long long) log->frames,
+         ok ? "match" : "MISMATCH");
+  FreeInputLog(log);
+  return ok ? 0 : 1;
+}
+
+// Run invaders for a number of frames and report where the cycles went
+static int profile_session(uint32_t frames)
+{
+  Machine *machine = InitMachine();
+  PcProfile *profile = CreatePcProfile();
+  uint32_t f;
+
+  for (f = 0; f < frames && MachineRunFrameProfiled(machine, profile); f++)
+    ;
+  PrintPcProfile(profile, machine->state->memory, PROFILE_TOP);
+  FreePcProfile(profile);
+  FreeMachine(machine);
+  return 0;
+}
+
+// Count memory traffic by page and region, dumping it every interval
+static int heatmap_session(uint32_t frames, uint32_t interval, const char *filename)
+{
+  FILE *out = fopen(filename, "w");
+  if (out == NULL)
+  {
+    printf("error: cannot write %s\n", filename);
+    return 1;
+  }
+
+  Machine *machine = InitMachine();
+  Heatmap *heatmap = CreateHeatmap(interval, out);
+  uint32_t f;
+
+  for (f = 0; f < frames && MachineRunFrameHeatmap(machine, heatmap); f++)
+    ;
+  PrintHeatmap(heatmap);
+  fclose(out);
+  FreeHeatmap(heatmap);
+  FreeMachine(machine);
+  return 0;
+}
+
+// Same with a call graph, written as collapsed stacks for flamegraphs
+static int callgraph_session(uint32_t frames, const char *filename)
+{
+  FILE *out = fopen(filename, "w");
+  if (out == NULL)
+  {
+    printf("error: cannot write %s\n", filename);
+    return 1;
+  }
+
+  Machine *machine = InitMachine();
+  CallGraph *graph = CreateCallGraph(machine->state->pc);
+  uint32_t f;
+
+  for (f = 0; f < frames && MachineRunFrameCallGraph(machine, graph); f++)
+    ;
+  CallGraphFinish(graph, machine->state);
+  WriteCollapsedStacks(graph, out);
+  fclose(out);
+  PrintCallGraph(graph, PROFILE_TOP);
+  FreeCallGraph(graph);
+  FreeMachine(machine);
+  return 0;
+}
+
+static volatile sig_atomic_t stop_publishing;
+
+static void on_stop_publishing(int sig)
+{
+  stop_publishing = 1;
+}
+
+// Run invaders until it halts or is interrupted, publishing counters for
+// emustat every frame
+static int publish_session(const char *name)
+{
+  CounterPublisher *publisher = CreateCounterPublisher(name);
+  if (publisher == NULL)
+  {
+    return 1;
+  }
+
+  Machine *machine = InitMachine();
+  int running;
+
+  //remove the segment on Ctrl-C or kill
+  signal(SIGINT, on_stop_publishing);
+  signal(SIGTERM, on_stop_publishing);
+  do
+  {
+    running = MachineRunFrame(machine);
+    PublishCounters(publisher, machine);
+  } while (running && !stop_publishing);
+  FreeCounterPublisher(publisher);
+  FreeMachine(machine);
+  return running ? 0 : 1;
+}
+
+// Run invaders writing a binary trace of every instruction
+static int trace_session(uint32_t frames, const char *filename)
+{
+  TraceWriter *trace = CreateTraceWriter(filename);
+  if (trace == NULL)
+  {
+    return 1;
+  }
+
+  Machine *machine = InitMachine();
+  uint32_t f;
+
+  for (f = 0; f < frames && MachineRunFrameTraced(machine, trace); f++)
+    ;
+  uint64_t instructions = trace->instructions;
+  int ok = CloseTraceWriter(trace);
+  printf("traced %llu instructions in %u frames%s\n",
+         (unsigned long long) instructions, f, ok ? "" : ", write failed");
+  FreeMachine(machine);
+  return ok ? 0 : 1;
+}
+
+static void load_invaders(CpuState* state)
 {
-  FILE *f = fopen(argv[1], "rb");
-  if (f == NULL)
-  {
-    printf("error: Couldn't open %s\n", argv[1]);
-    exit(1);
-  }
-  
-  // Get the file size and read it into a memory buffer
-  fseek(f, 0L, SEEK_END);
-  int fsize = ftell(f);
-  fseek(f, 0L, SEEK_SET);
-
-  unsigned char *buffer = malloc(fsize);
-  
-  fread(buffer, fsize, 1, f);
-  fclose(f);
-  
-  // Go through file and execute commands
-  int done = 0;
-  int vblankcycles = 0;
-  CpuState* state = Init8080();
-#ifdef DBG_TEST 
-  ReadFileIntoMemoryAt(state, "cpudiag.bin", 0x100);
-
-  //Fix the first instruction to be JMP 0x100    
-  state->memory[0]=0xc3;    
-  state->memory[1]=0;    
-  state->memory[2]=0x01;    
-
-  //Fix the stack pointer from 0x6ad to 0x7ad    
-  // this 0x06 byte 112 in the code, which is    
-  // byte 112 + 0x100 = 368 in memory    
-  state->memory[368] = 0x7;    
-
-  //Skip DAA test    
-  state->memory[0x59c] = 0xc3; //JMP    
-  state->memory[0x59d] = 0xc2;    
-  state->memory[0x59e] = 0x05;
-#else
   ReadFileIntoMemoryAt(state, "invaders.h", 0);
   ReadFileIntoMemoryAt(state, "invaders.g", 0x800);
   ReadFileIntoMemoryAt(state, "invaders.f", 0x1000);
   ReadFileIntoMemoryAt(state, "invaders.e", 0x1800);
-#endif
-
-#ifdef DBG_REF
-  CpuState* state_ref = Init8080();
-  ReadFileIntoMemoryAt(state_ref, "invaders.h", 0);
-  ReadFileIntoMemoryAt(state_ref, "invaders.g", 0x800);
-  ReadFileIntoMemoryAt(state_ref, "invaders.f", 0x1000);
-  ReadFileIntoMemoryAt(state_ref, "invaders.e", 0x1800);
-#endif
-
-  while (1)
-  {
-    Emulate8080Op(state);
-#ifdef DBG_REF
-    done = Emulate8080Op_ref(state_ref);
-    if (!compare_states(state, state_ref))
+}
+
+static void usage(void)
+{
+  printf("usage: emulator [mode]\n"
+         "  --plain                      run invaders (default)\n"
+         "  --cpudiag                    run cpudiag.bin with CP/M console calls\n"
+         "  --lockstep                   run invaders against the reference core\n"
+         "  --trace                      run invaders printing every instruction\n"
+         "  --fleet <machines> <frames>  run many invaders machines on all cores\n"
+         "  --coverage <machines> <frames>  ROM coverage over a fleet with\n"
+         "                               varied inputs\n"
+         "  --sample <machines> <frames> <cycles> <file>  sample a fleet every\n"
+         "                               <cycles>, write collapsed stacks to file\n"
+         "  --record <log> <frames>      record a scripted session\n"
+         "  --replay <log>               replay a recorded session\n"
+         "  --replay-parallel <log>      replay a session from its snapshots\n"
+         "  --profile <frames>           profile invaders, hottest code by cycles\n"
+         "  --callgraph <frames> <file>  profile invaders by subroutine, write\n"
+         "                               collapsed stacks to file\n"
+         "  --record-trace <frames> <file>  write a binary trace, see tracetool\n"
+         "  --heatmap <frames> <interval> <file>  memory traffic by page and\n"
+         "                               region, dumped to file every interval\n"
+         "  --publish <name>             run invaders publishing counters in shared\n"
+         "                               memory, see emustat\n"
+         "  --debug                      run invaders under the interactive debugger\n"
+         "  --gdb <port|socket>          run invaders with a gdb remote stub on a\n"
+         "                               localhost port or Unix socket path\n");
+}
+
+int main (int argc, char** argv)
+{
+  if (argc == 4 && strcmp(argv[1], "--fleet") == 0)
+  {
+    return run_fleet(atoi(argv[2]), atoi(argv[3]));
+  }
+  if (argc == 4 && strcmp(argv[1], "--coverage") == 0)
+  {
+    return coverage_session(atoi(argv[2]), atoi(argv[3]));
+  }
+  if (argc == 6 && strcmp(argv[1], "--sample") == 0)
+  {
+    return sample_session(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), argv[5]);
+  }
+  if (argc == 4 && strcmp(argv[1], "--record") == 0)
+  {
+    return record_session(argv[2], atoi(argv[3]));
+  }
+  if (argc == 3 && strcmp(argv[1], "--replay") == 0)
+  {
+    return replay_session(argv[2], 0);
+  }
+  if (argc == 3 && strcmp(argv[1], "--replay-parallel") == 0)
+  {
+    return replay_session(argv[2], 1);
+  }
+  if (argc == 3 && strcmp(argv[1], "--profile") == 0)
+  {
+    return profile_session(atoi(argv[2]));
+  }
+  if (argc == 5 && strcmp(argv[1], "--heatmap") == 0)
+  {
+    return heatmap_session(atoi(argv[2]), atoi(argv[3]), argv[4]);
+  }
+  if (argc == 4 && strcmp(argv[1], "--callgraph") == 0)
+  {
+    return callgraph_session(atoi(argv[2]), argv[3]);
+  }
+  if (argc == 3 && strcmp(argv[1], "--publish") == 0)
+  {
+    return publish_session(argv[2]);
+  }
+  if (argc == 4 && strcmp(argv[1], "--record-trace") == 0)
+  {
+    return trace_session(atoi(argv[2]), argv[3]);
+  }
+
+  if (argc == 2 && strcmp(argv[1], "--debug") == 0)
+  {
+    Machine *machine = InitMachine();
+    Debugger *debugger = CreateDebugger();
+    RunMonitor(machine, debugger, stdin);
+    FreeDebugger(debugger);
+    FreeMachine(machine);
+    return 0;
+  }
+  if (argc == 3 && strcmp(argv[1], "--gdb") == 0)
+  {
+    GdbStub *stub = CreateGdbStub(argv[2]);
+    if (stub == NULL)
     {
       return 1;
     }
-#endif
+    Machine *machine = InitMachine();
+    RunGdbStub(stub, machine);
+    FreeGdbStub(stub);
+    FreeMachine(machine);
+    return 0;
   }
-  return 0;
+
+  const char *mode = (argc > 1) ? argv[1] : "--plain";
+  CpuState* state = Init8080();
+
+  if (argc > 2)
+  {
+    usage();
+    return 1;
+  }
+
+  if (strcmp(mode, "--plain") == 0)
+  {
+    load_invaders(state);
+    RunLoopPlain(state, UINT64_MAX, NULL);
+  }
+  else if (strcmp(mode, "--cpudiag") == 0)
+  {
+    //console output is kept to judge the run the way cpmtest does
+    char *output = NULL;
+    size_t output_size = 0;
+    FILE *out = open_memstream(&output, &output_size);
+    CpmMachine *cpm = InitCpm(out);
+    CpmLoad(cpm, "cpudiag.bin");
+    RunLoopCpm(cpm->state, UINT64_MAX, cpm);
+    CpmFlush(cpm);
+    fclose(out);
+    fputs(output, stdout);
+
+    const char *reason = CpmVerdict(cpm, output);
+    if (reason)
+    {
+      printf("%scpudiag: %s\n",
+             output_size && output[output_size - 1] != '\n' ? "\n" : "", reason);
+    }
+    free(output);
+    FreeCpm(cpm);
+    return reason ? 1 : 0;
+  }
+  else if (strcmp(mode, "--trace") == 0)
+  {
+    load_invaders(state);
+    RunLoopTrace(state, UINT64_MAX, NULL);
+  }
+  else if (strcmp(mode, "--lockstep") == 0)
+  {
+    CpuState* state_ref = Init8080();
+    load_invaders(state);
+    load_invaders(state_ref);
+
+    //quiet lockstep, reports the first instruction the cores disagree on
+    RunDifferential(state, state_ref, UINT64_MAX, DIFF_CHECK_INTERVAL);
+  }
+  else
+  {
+    usage();
+  }
+  return 1;
 }
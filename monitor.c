@@ -0,0 +1,329 @@
+#include <signal.h>
+
+#include "monitor.h"
+#include "disassembler.h"
+
+#define MONITOR_LINE      256
+#define MONITOR_DISASM    10   // instructions shown by 'd'
+#define MONITOR_DUMP      64   // bytes shown by 'm'
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig)
+{
+  interrupted = 1;
+}
+
+static void help(void)
+{
+  printf("  s [n]              step n instructions\n"
+         "  c                  continue until a breakpoint or watchpoint\n"
+         "  u <addr>           run until pc reaches addr\n"
+         "  uc <cycles|+n>     run until the cycle count\n"
+         "  r                  registers\n"
+         "  m <addr> [n]       dump n bytes of memory\n"
+         "  d [addr] [n]       disassemble n instructions, around pc by default\n"
+         "  b <addr>, bc <addr>, bl\n"
+         "                     set, clear, list breakpoints\n"
+         "  w <addr> [n] [r|w|rw], wc <addr>\n"
+         "                     watch n bytes for reads and/or writes, clear\n"
+         "  q                  quit\n"
+         "addresses are hex, counts decimal; an empty line repeats the last command\n");
+}
+
+static int parse_addr(const char *text, uint16_t *addr)
+{
+  char *end;
+
+  if (*text == '$')
+  {
+    text++;
+  }
+  unsigned long x = strtoul(text, &end, 16);
+  if (end == text || *end != '\0' || x > 0xffff)
+  {
+    return 0;
+  }
+  *addr = x;
+  return 1;
+}
+
+/* Disassembly */
+
+// A start a few bytes before pc that decodes straight into pc, so there is
+// some code shown before it; pc itself when nothing lines up
+static uint16_t start_before(CpuState *state, uint16_t pc)
+{
+  int back;
+
+  for (back = 6; back > 0; back--)
+  {
+    uint16_t addr = pc - back;
+    while ((uint16_t) (pc - addr) <= back && addr != pc)
+    {
+      addr += Length8080Op(state->memory[addr]);
+    }
+    if (addr == pc)
+    {
+      return pc - back;
+    }
+  }
+  return pc;
+}
+
+static void disassemble(CpuState *state, uint16_t addr, int count)
+{
+  while (count-- > 0)
+  {
+    printf("%s", addr == state->pc ? "=> " : "   ");
+    addr += Disassemble8080Op(state->memory, addr);
+  }
+}
+
+static void show_state(Machine *machine)
+{
+  CpuState *state = machine->state;
+
+  printf("frame %llu, cycle %llu\n", (unsigned long long) machine->frames,
+         (unsigned long long) state->cycles);
+  printf("=> ");
+  Disassemble8080Op(state->memory, state->pc);
+  print_state(state);
+}
+
+static void dump_memory(CpuState *state, uint16_t addr, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (i % 16 == 0)
+    {
+      printf("%s%04x:", i ? "\n" : "", (uint16_t) (addr + i));
+    }
+    printf(" %02x", state->memory[(uint16_t) (addr + i)]);
+  }
+  printf("\n");
+}
+
+/* Running */
+
+static void run(Machine *machine, Debugger *debugger)
+{
+  CpuState *state = machine->state;
+
+  interrupted = 0;
+  signal(SIGINT, on_interrupt);
+  while (!interrupted && MachineRunFrameDebug(machine, debugger))
+    ;
+  signal(SIGINT, SIG_DFL);
+
+  if (state->halted)
+  {
+    printf("cpu halted\n");
+  }
+  else if (debugger->stop == DEBUG_BREAKPOINT)
+  {
+    printf("breakpoint at $%04x\n", debugger->stop_pc);
+  }
+  else if (debugger->stop == DEBUG_WATCHPOINT)
+  {
+    MemoryAccess *access = &debugger->stop_access;
+    printf("watchpoint: %s%s%s $%04x, %d bytes\n",
+           access->kind & ACCESS_READ ? "read" : "",
+           access->kind == (ACCESS_READ | ACCESS_WRITE) ? "/" : "",
+           access->kind & ACCESS_WRITE ? "write" : "",
+           access->addr, access->size);
+  }
+  else if (interrupted)
+  {
+    printf("interrupted\n");
+  }
+  debugger->steps = UINT64_MAX;
+  debugger->until_cycles = UINT64_MAX;
+  show_state(machine);
+}
+
+static void list_breakpoints(Debugger *debugger)
+{
+  int addr, i;
+
+  for (addr = 0; addr < I8080_MEMORY_SIZE; addr++)
+  {
+    if ((debugger->break_bits[addr >> 6] >> (addr & 63)) & 1)
+    {
+      printf("breakpoint $%04x\n", addr);
+    }
+  }
+  for (i = 0; i < debugger->num_watchpoints; i++)
+  {
+    Watchpoint *watch = &debugger->watch[i];
+    printf("watchpoint $%04x, %u bytes, %s%s\n", watch->addr, watch->size,
+           watch->kind & ACCESS_READ ? "r" : "", watch->kind & ACCESS_WRITE ? "w" : "");
+  }
+}
+
+static uint8_t parse_kind(const char *text)
+{
+  uint8_t kind = 0;
+
+  if (*text == '\0')
+  {
+    return ACCESS_WRITE;
+  }
+  for (; *text; text++)
+  {
+    if (*text == 'r')
+    {
+      kind |= ACCESS_READ;
+    }
+    else if (*text == 'w')
+    {
+      kind |= ACCESS_WRITE;
+    }
+    else
+    {
+      return 0;
+    }
+  }
+  return kind;
+}
+
+/* Execute one command line, 0 to quit */
+static int command(Machine *machine, Debugger *debugger, const char *line)
+{
+  CpuState *state = machine->state;
+  char cmd[16] = "", arg1[32] = "", arg2[32] = "", arg3[32] = "";
+  uint16_t addr;
+
+  sscanf(line, "%15s %31s %31s %31s", cmd, arg1, arg2, arg3);
+
+  if (strcmp(cmd, "q") == 0)
+  {
+    return 0;
+  }
+  else if (strcmp(cmd, "s") == 0)
+  {
+    debugger->steps = *arg1 ? strtoull(arg1, NULL, 10) : 1;
+    run(machine, debugger);
+  }
+  else if (strcmp(cmd, "c") == 0)
+  {
+    run(machine, debugger);
+  }
+  else if (strcmp(cmd, "u") == 0 && parse_addr(arg1, &addr))
+  {
+    int temporary = !((debugger->break_bits[addr >> 6] >> (addr & 63)) & 1);
+    DebugSetBreakpoint(debugger, addr);
+    run(machine, debugger);
+    if (temporary)
+    {
+      DebugClearBreakpoint(debugger, addr);
+    }
+  }
+  else if (strcmp(cmd, "uc") == 0 && *arg1)
+  {
+    uint64_t cycles = strtoull(arg1 + (*arg1 == '+'), NULL, 10);
+    debugger->until_cycles = *arg1 == '+' ? state->cycles + cycles : cycles;
+    run(machine, debugger);
+  }
+  else if (strcmp(cmd, "r") == 0)
+  {
+    show_state(machine);
+  }
+  else if (strcmp(cmd, "m") == 0 && parse_addr(arg1, &addr))
+  {
+    dump_memory(state, addr, *arg2 ? atoi(arg2) : MONITOR_DUMP);
+  }
+  else if (strcmp(cmd, "d") == 0)
+  {
+    if (*arg1 == '\0')
+    {
+      disassemble(state, start_before(state, state->pc), MONITOR_DISASM);
+    }
+    else if (parse_addr(arg1, &addr))
+    {
+      disassemble(state, addr, *arg2 ? atoi(arg2) : MONITOR_DISASM);
+    }
+  }
+  else if (strcmp(cmd, "b") == 0 && parse_addr(arg1, &addr))
+  {
+    DebugSetBreakpoint(debugger, addr);
+  }
+  else if (strcmp(cmd, "bc") == 0 && parse_addr(arg1, &addr))
+  {
+    if (!DebugClearBreakpoint(debugger, addr))
+    {
+      printf("error: no breakpoint at $%04x\n", addr);
+    }
+  }
+  else if (strcmp(cmd, "bl") == 0)
+  {
+    list_breakpoints(debugger);
+  }
+  else if (strcmp(cmd, "w") == 0 && parse_addr(arg1, &addr))
+  {
+    char *end = arg2;
+    unsigned long size = *arg2 ? strtoul(arg2, &end, 10) : 1;
+    uint8_t kind = parse_kind(arg3);
+    if (kind == 0 || *end != '\0')
+    {
+      printf("error: bad watchpoint\n");
+    }
+    else if (size == 0 || size > I8080_MEMORY_SIZE - addr)
+    {
+      printf("error: watchpoint size must be 1 to %u bytes at $%04x\n",
+             I8080_MEMORY_SIZE - addr, addr);
+    }
+    else if (!DebugAddWatchpoint(debugger, addr, size, kind))
+    {
+      printf("error: at most %d watchpoints\n", DEBUG_MAX_WATCHPOINTS);
+    }
+  }
+  else if (strcmp(cmd, "wc") == 0 && parse_addr(arg1, &addr))
+  {
+    if (!DebugRemoveWatchpoint(debugger, addr))
+    {
+      printf("error: no watchpoint at $%04x\n", addr);
+    }
+  }
+  else if (strcmp(cmd, "h") == 0 || strcmp(cmd, "help") == 0)
+  {
+    help();
+  }
+  else if (*cmd)
+  {
+    printf("error: bad command, h for help\n");
+  }
+  return 1;
+}
+
+void RunMonitor(Machine *machine, Debugger *debugger, FILE *in)
+{
+  char line[MONITOR_LINE];
+  char last[MONITOR_LINE] = "";
+
+  show_state(machine);
+  for (;;)
+  {
+    printf("(8080) ");
+    fflush(stdout);
+    if (fgets(line, sizeof(line), in) == NULL)
+    {
+      break;
+    }
+    if (strspn(line, " \t\r\n") == strlen(line))
+    {
+      strcpy(line, last);
+    }
+    else
+    {
+      strcpy(last, line);
+    }
+    if (!command(machine, debugger, line))
+    {
+      break;
+    }
+  }
+  printf("\n");
+}
@@ -0,0 +1,14 @@
+#ifndef I8080_MONITOR_H
+#define I8080_MONITOR_H
+
+#include <stdio.h>
+
+#include "debug.h"
+
+// Interactive debugger on a machine, reading commands from `in` until quit
+// or end of input. Runs go through MachineRunFrameDebug, so continue and
+// run-until execute at debug loop speed and stop on the breakpoint bitmap,
+// a step or cycle limit, or Ctrl-C at the next frame boundary.
+void RunMonitor(Machine *machine, Debugger *debugger, FILE *in);
+
+#endif /* I8080_MONITOR_H */
@@ -0,0 +1,311 @@
+#include <time.h>
+
+#include "machine.h"
+#include "runloop.h"
+
+// Copies of the instruction under test per loop iteration, so the closing
+// JMP is under 2% of the instructions executed
+#define BODY_REPEAT   64
+// Instructions timed per form and loop
+#define DEFAULT_STEPS 5000000
+// Runs per form and loop, the fastest one is reported
+#define DEFAULT_REPEATS 3
+
+// Every loop starts at LOOP_START, past the RST vectors, with this
+// prologue, then the body repeated, then a JMP back to the first body
+// byte. HL, BC and DE point at scratch RAM, SP at an empty stack and flags
+// are Z=1 CY=0 after XRA A.
+#define LOOP_START 0x0100
+static const uint8_t prologue[] = {
+  0x21, 0x00, 0x20,  //LXI H,$2000
+  0x01, 0x00, 0x21,  //LXI B,$2100
+  0x11, 0x00, 0x22,  //LXI D,$2200
+  0x31, 0x00, 0xf0,  //LXI SP,$f000
+  0xaf,              //XRA A
+};
+
+// Subroutine used by the CALL forms
+#define SUBROUTINE 0x8000
+// Vector of the RST form
+#define RST_VECTOR 0x0038
+
+typedef struct {
+  const char *name;
+  uint8_t    body[4];
+  uint8_t    size;     // bytes in body
+  uint8_t    next_at;  // offset of an address set to the next copy, 0 for none
+  uint8_t    machine;  // run by MachineStep, where the cabinet does IN/OUT
+} OpForm;
+
+// Paired forms ("CALL+RET") report the mean over both instructions
+static const OpForm forms[] = {
+  { "NOP",            { 0x00 },             1 },
+  { "MOV r,r",        { 0x41 },             1 },
+  { "MOV r,M",        { 0x46 },             1 },
+  { "MOV M,r",        { 0x70 },             1 },
+  { "MVI r,d8",       { 0x06, 0x55 },       2 },
+  { "MVI M,d8",       { 0x36, 0x55 },       2 },
+  { "LXI rp,d16",     { 0x01, 0x00, 0x21 }, 3 },
+  { "LDA a16",        { 0x3a, 0x00, 0x21 }, 3 },
+  { "STA a16",        { 0x32, 0x00, 0x21 }, 3 },
+  { "LHLD a16",       { 0x2a, 0x00, 0x21 }, 3 },
+  { "SHLD a16",       { 0x22, 0x00, 0x21 }, 3 },
+  { "LDAX rp",        { 0x0a },             1 },
+  { "STAX rp",        { 0x02 },             1 },
+  { "XCHG",           { 0xeb },             1 },
+  { "ADD r",          { 0x80 },             1 },
+  { "ADD M",          { 0x86 },             1 },
+  { "ADI d8",         { 0xc6, 0x01 },       2 },
+  { "ADC r",          { 0x88 },             1 },
+  { "ACI d8",         { 0xce, 0x01 },       2 },
+  { "SUB r",          { 0x90 },             1 },
+  { "SUI d8",         { 0xd6, 0x01 },       2 },
+  { "SBB r",          { 0x98 },             1 },
+  { "SBI d8",         { 0xde, 0x01 },       2 },
+  { "INR r",          { 0x04 },             1 },
+  { "INR M",          { 0x34 },             1 },
+  { "DCR r",          { 0x05 },             1 },
+  { "DCR M",          { 0x35 },             1 },
+  { "INX rp",         { 0x03 },             1 },
+  { "DAD rp",         { 0x09 },             1 },
+  { "ANA r",          { 0xa0 },             1 },
+  { "XRA r",          { 0xa8 },             1 },
+  { "ORA r",          { 0xb0 },             1 },
+  { "CMP r",          { 0xb8 },             1 },
+  { "ANI d8",         { 0xe6, 0xff },       2 },
+  { "XRI d8",         { 0xee, 0x55 },       2 },
+  { "ORI d8",         { 0xf6, 0x00 },       2 },
+  { "CPI d8",         { 0xfe, 0x01 },       2 },
+  { "DAA",            { 0x27 },             1 },
+  { "RLC",            { 0x07 },             1 },
+  { "RRC",            { 0x0f },             1 },
+  { "RAL",            { 0x17 },             1 },
+  { "RAR",            { 0x1f },             1 },
+  { "CMA",            { 0x2f },             1 },
+  { "STC",            { 0x37 },             1 },
+  { "CMC",            { 0x3f },             1 },
+  { "JMP a16",        { 0xc3 },             3, 1 },
+  { "Jcc taken",      { 0xca },             3, 1 },  //JZ with Z=1
+  { "Jcc not taken",  { 0xc2 },             3, 1 },  //JNZ with Z=1
+  { "LXI H+PCHL",     { 0x21, 0x00, 0x00, 0xe9 }, 4, 1 },
+  { "CALL+RET",       { 0xcd, SUBROUTINE & 0xff, SUBROUTINE >> 8 }, 3 },
+  { "Ccc+RET taken",  { 0xcc, SUBROUTINE & 0xff, SUBROUTINE >> 8 }, 3 },
+  { "Ccc not taken",  { 0xc4, SUBROUTINE & 0xff, SUBROUTINE >> 8 }, 3 },
+  { "Rcc not taken",  { 0xc0, 0x00, 0x00 }, 3 },  //RNZ with Z=1, the core steps 3 bytes
+  { "RST+RET",        { 0xff, 0x00, 0x00 }, 3 },  //the core returns 3 bytes past RST 7
+  { "PUSH+POP",       { 0xc5, 0xc1 },       2 },
+  { "PUSH+POP PSW",   { 0xf5, 0xf1 },       2 },
+  { "XTHL",           { 0xe3 },             1 },
+  { "SPHL+LXI SP",    { 0xf9, 0x31, 0x00, 0xf0 }, 4 },
+  { "EI",             { 0xfb },             1 },
+  { "DI",             { 0xf3 },             1 },
+  { "IN d8",          { 0xdb, 0x03 },       2, 0, 1 },  //shift register result
+  { "OUT d8",         { 0xd3, 0x04 },       2, 0, 1 },  //shift register data
+};
+
+/* Lay out prologue, repeated body and closing jump at LOOP_START */
+static void build_loop(CpuState *state, const OpForm *form)
+{
+  uint16_t pc = LOOP_START + sizeof(prologue);
+  uint16_t loop = pc;
+  int i;
+
+  uint8_t *memory = state->memory;
+
+  memset(state, 0, sizeof(CpuState));
+  state->memory = memory;
+  memset(memory, 0, I8080_MEMORY_SIZE);
+  memcpy(&state->memory[LOOP_START], prologue, sizeof(prologue));
+
+  for (i = 0; i < BODY_REPEAT; i++)
+  {
+    memcpy(&state->memory[pc], form->body, form->size);
+    //jumps go to the next copy so the loop stays linear
+    if (form->next_at)
+    {
+      state->memory[pc + form->next_at] = (pc + form->size) & 0xff;
+      state->memory[pc + form->next_at + 1] = (pc + form->size) >> 8;
+    }
+    pc += form->size;
+  }
+  state->memory[pc] = 0xc3;  //JMP loop
+  state->memory[pc + 1] = loop & 0xff;
+  state->memory[pc + 2] = loop >> 8;
+
+  state->memory[SUBROUTINE] = 0xc9;  //RET
+  state->memory[RST_VECTOR] = 0xc9;
+  state->pc = LOOP_START;
+}
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Step through the cabinet, for the forms only it implements */
+static uint64_t step_machine(Machine *machine, uint64_t steps)
+{
+  uint64_t i;
+
+  for (i = 0; i < steps && !machine->state->halted; i++)
+  {
+    MachineStep(machine);
+  }
+  return i;
+}
+
+/* ns per instruction calling the core directly, or MachineStep */
+static double time_emulate(Machine *machine, const OpForm *form, uint64_t steps)
+{
+  CpuState *state = machine->state;
+  uint64_t i;
+
+  build_loop(state, form);
+  double start = now_seconds();
+  if (form->machine)
+  {
+    i = step_machine(machine, steps);
+  }
+  else
+  {
+    for (i = 0; i < steps && !state->halted; i++)
+    {
+      Emulate8080Op(state);
+    }
+  }
+  return (now_seconds() - start) * 1e9 / i;
+}
+
+/* ns per instruction through the plain run loop */
+static double time_run_loop(CpuState *state, const OpForm *form, uint64_t steps)
+{
+  build_loop(state, form);
+  double start = now_seconds();
+  uint64_t n = RunLoopPlain(state, steps, NULL);
+  return (now_seconds() - start) * 1e9 / n;
+}
+
+typedef struct {
+  const OpForm *form;
+  double   ns_emulate;
+  double   ns_run_loop;    // -1 for forms run by MachineStep
+  double   cycles;
+  int      halted;
+} OpTiming;
+
+static int by_cost(const void *a, const void *b)
+{
+  double x = ((const OpTiming *) a)->ns_emulate;
+  double y = ((const OpTiming *) b)->ns_emulate;
+  return (x < y) - (x > y);
+}
+
+int main (int argc, char** argv)
+{
+  size_t num_forms = sizeof(forms) / sizeof(forms[0]);
+  OpTiming timings[sizeof(forms) / sizeof(forms[0])];
+  uint64_t steps = DEFAULT_STEPS;
+  int repeats = DEFAULT_REPEATS;
+  int sorted = 0;
+  size_t i;
+  int run;
+
+  for (i = 1; i < (size_t) argc; i++)
+  {
+    if (strcmp(argv[i], "-s") == 0)
+    {
+      sorted = 1;
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < (size_t) argc)
+    {
+      steps = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < (size_t) argc)
+    {
+      repeats = atoi(argv[++i]);
+    }
+    else
+    {
+      printf("usage: opbench [-s] [-n steps] [-r repeats]\n"
+             "  -s  sort by cost, slowest first\n"
+             "  -r  runs per form, the fastest is reported (default %d)\n",
+             DEFAULT_REPEATS);
+      return 1;
+    }
+  }
+  if (repeats < 1)
+  {
+    repeats = 1;
+  }
+
+  //a bare cabinet around the cpu for IN/OUT, no ROM needed
+  Machine machine;
+  memset(&machine, 0, sizeof(Machine));
+  machine.state = Init8080();
+  CpuState *state = machine.state;
+
+  for (i = 0; i < num_forms; i++)
+  {
+    OpTiming *timing = &timings[i];
+    const OpForm *form = &forms[i];
+    timing->form = form;
+    timing->ns_run_loop = -1;
+    timing->halted = 0;
+
+    for (run = 0; run < repeats; run++)
+    {
+      double ns = time_emulate(&machine, form, steps);
+      if (state->halted)
+      {
+        timing->halted = 1;
+        break;
+      }
+      timing->ns_emulate = (run == 0 || ns < timing->ns_emulate) ? ns : timing->ns_emulate;
+      if (!form->machine)
+      {
+        ns = time_run_loop(state, form, steps);
+        timing->ns_run_loop = (run == 0 || ns < timing->ns_run_loop) ? ns : timing->ns_run_loop;
+      }
+    }
+    if (timing->halted)
+    {
+      continue;
+    }
+
+    //cycles per instruction, from a short extra pass
+    build_loop(state, form);
+    uint64_t n = form->machine ? step_machine(&machine, 100000)
+                               : RunLoopPlain(state, 100000, NULL);
+    timing->cycles = (double) state->cycles / n;
+  }
+  Free8080(state);
+
+  if (sorted)
+  {
+    qsort(timings, num_forms, sizeof(OpTiming), by_cost);
+  }
+
+  printf("%-16s %14s %14s %12s\n", "form", "Emulate8080Op", "RunLoopPlain",
+         "cycles");
+  printf("%-16s %14s %14s %12s\n", "", "ns/op", "ns/op", "per op");
+  for (i = 0; i < num_forms; i++)
+  {
+    OpTiming *timing = &timings[i];
+    if (timing->halted)
+    {
+      printf("%-16s %14s\n", timing->form->name, "unimplemented");
+      continue;
+    }
+    if (timing->ns_run_loop < 0)
+    {
+      printf("%-16s %14.2f %14s %12.2f\n", timing->form->name,
+             timing->ns_emulate, "MachineStep", timing->cycles);
+      continue;
+    }
+    printf("%-16s %14.2f %14.2f %12.2f\n", timing->form->name,
+           timing->ns_emulate, timing->ns_run_loop, timing->cycles);
+  }
+  return 0;
+}
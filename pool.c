@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "machine.h"
+#include "pool.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// An instance and the machine around it, handed out together
+typedef struct {
+  CpuInstance cpu;
+  Machine     machine;
+} PoolSlot;
+
+struct CpuPool {
+  pthread_mutex_t lock;
+  PoolSlot        *slab;
+  size_t          slab_size;
+  int             mapped;     // slab came from mmap rather than aligned_alloc
+  int             *free_list; // stack of free instance indices
+  int             num_free;
+  int             capacity;
+  uint8_t         *image;     // copied into acquired instances, NULL for none
+  uint32_t        image_size;
+};
+
+static PoolSlot* map_slab(size_t size, int huge_pages)
+{
+  void *slab = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (huge_pages)
+  {
+    //needs huge pages reserved in /proc/sys/vm/nr_hugepages
+    slab = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (slab == MAP_FAILED)
+  {
+    slab = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+    if (slab != MAP_FAILED && huge_pages)
+    {
+      madvise(slab, size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  return (slab == MAP_FAILED) ? NULL : slab;
+}
+
+CpuPool* CreateCpuPool(int capacity, int huge_pages)
+{
+  CpuPool* pool = calloc(1, sizeof(CpuPool));
+  int i;
+
+  pool->capacity = capacity;
+  pool->slab_size = (size_t) capacity * sizeof(PoolSlot);
+
+  if (huge_pages)
+  {
+    //mmap hands back page aligned, zeroed memory
+    pool->slab_size = (pool->slab_size + HUGE_PAGE_SIZE - 1) & ~((size_t) HUGE_PAGE_SIZE - 1);
+    pool->slab = map_slab(pool->slab_size, huge_pages);
+    pool->mapped = (pool->slab != NULL);
+  }
+  if (pool->slab == NULL)
+  {
+    pool->slab = aligned_alloc(I8080_CACHE_LINE, pool->slab_size);
+    memset(pool->slab, 0, pool->slab_size);
+  }
+
+  pool->free_list = malloc(capacity * sizeof(int));
+  for (i = 0; i < capacity; i++)
+  {
+    //hand out low addresses first
+    pool->free_list[i] = capacity - 1 - i;
+  }
+  pool->num_free = capacity;
+  pthread_mutex_init(&pool->lock, NULL);
+  return pool;
+}
+
+void DestroyCpuPool(CpuPool* pool)
+{
+  if (pool->mapped)
+  {
+    munmap(pool->slab, pool->slab_size);
+  }
+  else
+  {
+    free(pool->slab);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->image);
+  free(pool->free_list);
+  free(pool);
+}
+
+void PoolSetImage(CpuPool* pool, const uint8_t *image, uint32_t size)
+{
+  if (size > I8080_MEMORY_SIZE)
+  {
+    size = I8080_MEMORY_SIZE;
+  }
+  free(pool->image);
+  pool->image = malloc(size);
+  memcpy(pool->image, image, size);
+  pool->image_size = size;
+}
+
+CpuState* PoolAcquire8080(CpuPool* pool)
+{
+  PoolSlot* slot = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->num_free > 0)
+  {
+    slot = &pool->slab[pool->free_list[--pool->num_free]];
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (slot == NULL)
+  {
+    return NULL;
+  }
+
+  //recycled instances must not leak state from their last run
+  memset(slot, 0, sizeof(PoolSlot));
+  slot->cpu.state.memory = slot->cpu.memory;
+  if (pool->image)
+  {
+    memcpy(slot->cpu.memory, pool->image, pool->image_size);
+  }
+  return &slot->cpu.state;
+}
+
+void PoolRelease8080(CpuPool* pool, CpuState* state)
+{
+  PoolSlot* slot = (PoolSlot*) state;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->free_list[pool->num_free++] = slot - pool->slab;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+Machine* PoolMachine(CpuPool* pool, CpuState* state)
+{
+  return &((PoolSlot*) state)->machine;
+}
@@ -0,0 +1,33 @@
+#ifndef I8080_POOL_H
+#define I8080_POOL_H
+
+#include "emulator.h"
+
+// Fixed-size pool of cpu instances carved out of one slab.
+//
+// Acquiring and releasing instances never calls the allocator, so fleets can
+// recycle machines freely. Each instance has its Machine wrapper stored next
+// to it, and the pool can hold a memory image, like a ROM, that acquired
+// instances start with instead of reloading it. The slab can be backed by
+// huge pages to cut TLB misses when thousands of 64K address spaces are live.
+typedef struct CpuPool CpuPool;
+typedef struct Machine Machine;
+
+// Create a pool of `capacity` instances.
+//   huge_pages: try MAP_HUGETLB first, then transparent huge pages
+CpuPool* CreateCpuPool(int capacity, int huge_pages);
+void DestroyCpuPool(CpuPool* pool);
+
+// Copy `size` bytes from `image` into the pool; acquired instances get
+// them at address 0.
+void PoolSetImage(CpuPool* pool, const uint8_t *image, uint32_t size);
+
+// Take an instance with zeroed registers and RAM, holding the pool's image
+// if it has one, NULL when exhausted. Safe to call from several threads.
+CpuState* PoolAcquire8080(CpuPool* pool);
+void PoolRelease8080(CpuPool* pool, CpuState* state);
+
+// The zeroed Machine stored next to an acquired instance.
+Machine* PoolMachine(CpuPool* pool, CpuState* state);
+
+#endif /* I8080_POOL_H */
@@ -0,0 +1,167 @@
+#include "profile.h"
+#include "disassembler.h"
+
+PcProfile* CreatePcProfile(void)
+{
+  return calloc(1, sizeof(PcProfile));
+}
+
+void FreePcProfile(PcProfile *profile)
+{
+  free(profile);
+}
+
+static inline int profile_before(Machine *machine, PcProfile *profile)
+{
+  profile->pc = machine->state->pc;
+  profile->start = machine->state->cycles;
+  return HOOK_CONTINUE;
+}
+
+static inline int profile_after(Machine *machine, PcProfile *profile)
+{
+  profile->exec[profile->pc]++;
+  profile->cycles[profile->pc] += machine->state->cycles - profile->start;
+  return HOOK_CONTINUE;
+}
+
+DEFINE_MACHINE_RUN_FRAME(MachineRunFrameProfiled, PcProfile,
+                         profile_before, profile_after, no_machine_hook,
+                         no_machine_limit)
+
+/* Report */
+
+// True when execution may not continue at the next instruction
+static int ends_block(uint8_t opcode)
+{
+  switch (opcode & 0xc7)
+  {
+    case 0xc0:  //Rcc
+    case 0xc2:  //Jcc
+    case 0xc4:  //Ccc
+    case 0xc7:  //RST
+      return 1;
+  }
+  return opcode == 0xc3 || opcode == 0xc9 || opcode == 0xcd ||
+         opcode == 0xe9 || opcode == 0x76;
+}
+
+typedef struct {
+  uint16_t addr;
+  uint16_t instructions;   // block length, 1 for single addresses
+  uint64_t exec;
+  uint64_t cycles;
+} HotSpot;
+
+static int by_cycles(const void *a, const void *b)
+{
+  uint64_t x = ((const HotSpot *) a)->cycles;
+  uint64_t y = ((const HotSpot *) b)->cycles;
+  return (x < y) - (x > y);
+}
+
+static void print_hot_spots(HotSpot *spots, int count, int top, uint8_t *memory,
+                            uint64_t total)
+{
+  int i, j;
+
+  qsort(spots, count, sizeof(HotSpot), by_cycles);
+  for (i = 0; i < count && i < top; i++)
+  {
+    uint16_t pc = spots[i].addr;
+    printf("%12llu %12llu %5.1f%% ", (unsigned long long) spots[i].exec,
+           (unsigned long long) spots[i].cycles,
+           100.0 * spots[i].cycles / total);
+    for (j = 0; j < spots[i].instructions; j++)
+    {
+      if (j > 0)
+      {
+        printf("%33s", "");
+      }
+      pc += Disassemble8080Op(memory, pc);
+    }
+  }
+}
+
+void PrintPcProfile(PcProfile *profile, uint8_t *memory, int top)
+{
+  HotSpot *spots = malloc(I8080_MEMORY_SIZE * sizeof(HotSpot));
+  uint64_t total = 0;
+  int count = 0;
+  int addr;
+
+  for (addr = 0; addr < I8080_MEMORY_SIZE; addr++)
+  {
+    if (profile->exec[addr])
+    {
+      spots[count].addr = addr;
+      spots[count].instructions = 1;
+      spots[count].exec = profile->exec[addr];
+      spots[count].cycles = profile->cycles[addr];
+      total += profile->cycles[addr];
+      count++;
+    }
+  }
+  if (total == 0)
+  {
+    printf("profile: nothing executed\n");
+    free(spots);
+    return;
+  }
+
+  printf("hot addresses (%llu cycles):\n", (unsigned long long) total);
+  printf("%12s %12s %6s  code\n", "exec", "cycles", "share");
+  print_hot_spots(spots, count, top, memory, total);
+
+  // Branch targets of executed code start blocks, and a block runs on while
+  // the next instruction follows straight on. Counts inside a block can be
+  // off by a few where a frame or an interrupt cut it short, so a block is
+  // reported with the count of its entry.
+  uint8_t *leader = calloc(I8080_MEMORY_SIZE, 1);
+  for (addr = 0; addr < I8080_MEMORY_SIZE; addr++)
+  {
+    uint8_t opcode = memory[addr];
+    if (profile->exec[addr] == 0 || !ends_block(opcode))
+    {
+      continue;
+    }
+    if ((opcode & 0xc7) == 0xc7)
+    {
+      leader[opcode & 0x38] = 1;   //RST
+    }
+    else if (Length8080Op(opcode) == 3)
+    {
+      leader[memory[(uint16_t) (addr + 1)] | (memory[(uint16_t) (addr + 2)] << 8)] = 1;
+    }
+  }
+
+  count = 0;
+  int next = -1;
+  for (addr = 0; addr < I8080_MEMORY_SIZE; addr++)
+  {
+    uint64_t exec = profile->exec[addr];
+    if (exec == 0)
+    {
+      continue;
+    }
+    if (addr != next || leader[addr])
+    {
+      spots[count].addr = addr;
+      spots[count].instructions = 0;
+      spots[count].exec = exec;
+      spots[count].cycles = 0;
+      count++;
+    }
+    spots[count - 1].instructions++;
+    spots[count - 1].cycles += profile->cycles[addr];
+
+    uint8_t opcode = memory[addr];
+    next = ends_block(opcode) ? -1 : addr + Length8080Op(opcode);
+  }
+  free(leader);
+
+  printf("\nhot basic blocks:\n");
+  printf("%12s %12s %6s  code\n", "exec", "cycles", "share");
+  print_hot_spots(spots, count, top, memory, total);
+  free(spots);
+}
@@ -0,0 +1,29 @@
+#ifndef I8080_PROFILE_H
+#define I8080_PROFILE_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+// Flat per-pc profile: executions and cycles for every address.
+//
+// Counting lives in its own frame loop, MachineRunFrameProfiled, so the
+// plain MachineRunFrame has no trace of it.
+typedef struct {
+  uint64_t exec[I8080_MEMORY_SIZE];
+  uint64_t cycles[I8080_MEMORY_SIZE];
+  uint16_t pc;           // instruction being executed
+  uint64_t start;        // cycle count before it
+} PcProfile;
+
+PcProfile* CreatePcProfile(void);
+void FreePcProfile(PcProfile *profile);
+
+// MachineRunFrame, counting every instruction into the profile.
+int MachineRunFrameProfiled(Machine *machine, PcProfile *profile);
+
+// Print the `top` hottest addresses and basic blocks by cycles, with
+// the code disassembled from `memory`.
+void PrintPcProfile(PcProfile *profile, uint8_t *memory, int top);
+
+#endif /* I8080_PROFILE_H */
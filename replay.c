@@ -0,0 +1,502 @@
+#include "replay.h"
+#include "fleet.h"
+
+static const char log_magic[8] = "8080REC1";
+
+// Record tags
+#define LOG_INPUT 0x01  // varint cycle delta, port, value
+#define LOG_HASH  0x02  // varint frame, 8 byte state hash
+#define LOG_SNAP  0x03  // varint frame, varint last input cycle, 8 byte
+                        // state hash, MACHINE_SNAPSHOT_SIZE bytes of machine
+
+/* Buffer helpers */
+static void put_byte(InputLog *log, uint8_t x)
+{
+  if (log->size == log->capacity)
+  {
+    log->capacity = log->capacity ? log->capacity * 2 : 4096;
+    log->data = realloc(log->data, log->capacity);
+  }
+  log->data[log->size++] = x;
+}
+
+static void put_varint(InputLog *log, uint64_t x)
+{
+  while (x >= 0x80)
+  {
+    put_byte(log, (x & 0x7f) | 0x80);
+    x >>= 7;
+  }
+  put_byte(log, x);
+}
+
+static void put_u64(InputLog *log, uint64_t x)
+{
+  int i;
+  for (i = 0; i < 8; i++)
+  {
+    put_byte(log, (x >> (8 * i)) & 0xff);
+  }
+}
+
+static int get_byte(InputLog *log, uint8_t *x)
+{
+  if (log->pos >= log->size)
+  {
+    return 0;
+  }
+  *x = log->data[log->pos++];
+  return 1;
+}
+
+static int get_varint(InputLog *log, uint64_t *x)
+{
+  uint8_t byte;
+  int shift = 0;
+
+  *x = 0;
+  do
+  {
+    if (!get_byte(log, &byte) || shift > 63)
+    {
+      return 0;
+    }
+    *x |= (uint64_t) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return 1;
+}
+
+static int get_u64(InputLog *log, uint64_t *x)
+{
+  uint8_t byte;
+  int i;
+
+  *x = 0;
+  for (i = 0; i < 8; i++)
+  {
+    if (!get_byte(log, &byte))
+    {
+      return 0;
+    }
+    *x |= (uint64_t) byte << (8 * i);
+  }
+  return 1;
+}
+
+static void set_mismatch(InputLog *log, const char *what)
+{
+  if (!log->mismatch)
+  {
+    log->mismatch = 1;
+    log->mismatch_frame = log->frames;
+    printf("replay: %s mismatch at frame %llu\n", what,
+           (unsigned long long) log->frames);
+  }
+}
+
+/* Hash records, frame 0 is the starting state */
+static void hash_record(InputLog *log, Machine *machine)
+{
+  uint64_t hash = Hash8080(machine->state);
+  uint64_t frame, expected;
+  uint8_t tag;
+
+  if (!log->replaying)
+  {
+    put_byte(log, LOG_HASH);
+    put_varint(log, log->frames);
+    put_u64(log, hash);
+    return;
+  }
+
+  if (!get_byte(log, &tag) || tag != LOG_HASH ||
+      !get_varint(log, &frame) || frame != log->frames ||
+      !get_u64(log, &expected))
+  {
+    set_mismatch(log, "input count");
+  }
+  else if (expected != hash)
+  {
+    set_mismatch(log, "state hash");
+  }
+}
+
+/* Snapshot records, replay checks the hash and the snapshot bytes */
+static void snapshot_record(InputLog *log, Machine *machine)
+{
+  uint64_t hash = Hash8080(machine->state);
+  uint64_t frame, last_cycles, expected;
+  uint8_t tag;
+
+  if (!log->replaying)
+  {
+    put_byte(log, LOG_SNAP);
+    put_varint(log, log->frames);
+    put_varint(log, log->last_cycles);
+    put_u64(log, hash);
+    while (log->size + MACHINE_SNAPSHOT_SIZE > log->capacity)
+    {
+      log->capacity *= 2;
+      log->data = realloc(log->data, log->capacity);
+    }
+    MachineSaveSnapshot(machine, &log->data[log->size]);
+    log->size += MACHINE_SNAPSHOT_SIZE;
+    return;
+  }
+
+  if (!get_byte(log, &tag) || tag != LOG_SNAP ||
+      !get_varint(log, &frame) || frame != log->frames ||
+      !get_varint(log, &last_cycles) || !get_u64(log, &expected) ||
+      log->pos + MACHINE_SNAPSHOT_SIZE > log->size)
+  {
+    set_mismatch(log, "input count");
+  }
+  else if (expected != hash)
+  {
+    set_mismatch(log, "checkpoint hash");
+  }
+  else
+  {
+    //the snapshot bytes must hold this state too, parallel replay starts
+    //there; only the input ports differ, replay reads them from the log
+    uint8_t *snapshot = malloc(MACHINE_SNAPSHOT_SIZE);
+    MachineSaveSnapshot(machine, snapshot);
+    memcpy(&snapshot[MACHINE_SNAPSHOT_PORTS],
+           &log->data[log->pos + MACHINE_SNAPSHOT_PORTS], 2);
+    if (memcmp(snapshot, &log->data[log->pos], MACHINE_SNAPSHOT_SIZE) != 0)
+    {
+      set_mismatch(log, "checkpoint snapshot");
+    }
+    free(snapshot);
+    log->pos += MACHINE_SNAPSHOT_SIZE;
+  }
+}
+
+InputLog* CreateInputLog(uint32_t hash_interval, uint32_t snapshot_interval)
+{
+  InputLog *log = calloc(1, sizeof(InputLog));
+  log->hash_interval = hash_interval;
+  log->snapshot_interval = snapshot_interval;
+  return log;
+}
+
+InputLog* LoadInputLog(const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL)
+  {
+    printf("error: Couldn't open %s\n", filename);
+    return NULL;
+  }
+
+  InputLog *log = calloc(1, sizeof(InputLog));
+  fseek(f, 0L, SEEK_END);
+  log->size = log->capacity = ftell(f);
+  fseek(f, 0L, SEEK_SET);
+  log->data = malloc(log->size);
+  fread(log->data, log->size, 1, f);
+  fclose(f);
+
+  uint64_t interval, snapshot_interval;
+  if (log->size < sizeof(log_magic) ||
+      memcmp(log->data, log_magic, sizeof(log_magic)) != 0)
+  {
+    printf("error: %s is not an input log\n", filename);
+    FreeInputLog(log);
+    return NULL;
+  }
+  log->pos = sizeof(log_magic);
+  if (!get_varint(log, &interval) || !get_varint(log, &snapshot_interval) ||
+      !get_varint(log, &log->total_frames))
+  {
+    printf("error: %s is truncated\n", filename);
+    FreeInputLog(log);
+    return NULL;
+  }
+  log->hash_interval = interval;
+  log->snapshot_interval = snapshot_interval;
+  log->replaying = 1;
+  return log;
+}
+
+int SaveInputLog(InputLog *log, const char *filename)
+{
+  FILE *f = fopen(filename, "wb");
+  if (f == NULL)
+  {
+    printf("error: Couldn't open %s\n", filename);
+    return 0;
+  }
+
+  //header goes in a scratch log so it can share the varint encoder
+  InputLog header = {0};
+  put_varint(&header, log->hash_interval);
+  put_varint(&header, log->snapshot_interval);
+  put_varint(&header, log->frames);
+
+  fwrite(log_magic, sizeof(log_magic), 1, f);
+  fwrite(header.data, header.size, 1, f);
+  fwrite(log->data, log->size, 1, f);
+  free(header.data);
+  fclose(f);
+  return 1;
+}
+
+void FreeInputLog(InputLog *log)
+{
+  free(log->data);
+  free(log);
+}
+
+int InputLogAttach(InputLog *log, Machine *machine)
+{
+  machine->log = log;
+  log->last_cycles = machine->state->cycles;
+  hash_record(log, machine);
+  if (log->snapshot_interval && !log->mismatch)
+  {
+    snapshot_record(log, machine);
+  }
+  return !log->mismatch;
+}
+
+uint8_t InputLogRead(InputLog *log, Machine *machine, uint8_t port, uint8_t value)
+{
+  uint64_t cycles = machine->state->cycles;
+  uint64_t delta;
+  uint8_t tag, logged_port, logged_value;
+
+  if (!log->replaying)
+  {
+    put_byte(log, LOG_INPUT);
+    put_varint(log, cycles - log->last_cycles);
+    put_byte(log, port);
+    put_byte(log, value);
+    log->last_cycles = cycles;
+    return value;
+  }
+
+  if (log->mismatch)
+  {
+    return value;
+  }
+  if (!get_byte(log, &tag) || tag != LOG_INPUT ||
+      !get_varint(log, &delta) ||
+      !get_byte(log, &logged_port) || !get_byte(log, &logged_value))
+  {
+    set_mismatch(log, "input count");
+    return value;
+  }
+  if (log->last_cycles + delta != cycles || logged_port != port)
+  {
+    set_mismatch(log, "input timing");
+    return value;
+  }
+
+  log->last_cycles = cycles;
+  return logged_value;
+}
+
+void InputLogFrame(InputLog *log, Machine *machine)
+{
+  log->frames++;
+  if (log->hash_interval && (log->frames % log->hash_interval) == 0 &&
+      !log->mismatch)
+  {
+    hash_record(log, machine);
+  }
+  if (log->snapshot_interval && (log->frames % log->snapshot_interval) == 0 &&
+      !log->mismatch)
+  {
+    snapshot_record(log, machine);
+  }
+}
+
+int ReplayInputLog(InputLog *log, Machine *machine)
+{
+  if (!InputLogAttach(log, machine))
+  {
+    return 0;
+  }
+
+  while (log->frames < log->total_frames && !log->mismatch)
+  {
+    if (!MachineRunFrame(machine))
+    {
+      set_mismatch(log, "halt");
+    }
+  }
+
+  //every record should have been consumed
+  if (!log->mismatch && log->pos != log->size)
+  {
+    set_mismatch(log, "input count");
+  }
+  machine->log = NULL;
+  return !log->mismatch;
+}
+
+/* Step over one record while indexing, @return: its tag or 0 at the end */
+static uint8_t skip_record(InputLog *log)
+{
+  uint64_t x;
+  uint8_t tag;
+
+  if (!get_byte(log, &tag))
+  {
+    return 0;
+  }
+  switch (tag)
+  {
+    case LOG_INPUT:
+      get_varint(log, &x);
+      log->pos += 2;
+      break;
+    case LOG_HASH:
+      get_varint(log, &x);
+      log->pos += 8;
+      break;
+    case LOG_SNAP:
+      get_varint(log, &x);
+      get_varint(log, &x);
+      log->pos += 8 + MACHINE_SNAPSHOT_SIZE;
+      break;
+    default:
+      return 0;
+  }
+  return (log->pos <= log->size) ? tag : 0;
+}
+
+int ReplayInputLogParallel(InputLog *log, int workers)
+{
+  size_t header_end = log->pos;
+  size_t *offsets;
+  int num_snapshots = 0;
+  int capacity = 16;
+  int i, ok = 1;
+
+  //index the snapshot records
+  offsets = malloc(capacity * sizeof(size_t));
+  for (;;)
+  {
+    size_t offset = log->pos;
+    uint8_t tag = skip_record(log);
+    if (tag == 0)
+    {
+      break;
+    }
+    if (tag == LOG_SNAP)
+    {
+      if (num_snapshots == capacity)
+      {
+        capacity *= 2;
+        offsets = realloc(offsets, capacity * sizeof(size_t));
+      }
+      offsets[num_snapshots++] = offset;
+    }
+  }
+  log->pos = header_end;
+
+  if (num_snapshots == 0)
+  {
+    printf("replay: log has no snapshots\n");
+    free(offsets);
+    return 0;
+  }
+
+  //one machine per segment, started from its snapshot
+  InputLog *segments = calloc(num_snapshots, sizeof(InputLog));
+  Machine **machines = malloc(num_snapshots * sizeof(Machine*));
+  uint32_t *frames = malloc(num_snapshots * sizeof(uint32_t));
+  uint64_t *first_frame = malloc(num_snapshots * sizeof(uint64_t));
+  CpuPool *pool = CreateMachinePool(num_snapshots, 1);
+
+  for (i = 0; i < num_snapshots; i++)
+  {
+    InputLog *segment = &segments[i];
+    uint64_t frame, last_cycles, hash;
+    uint8_t tag;
+
+    *segment = *log;
+    segment->pos = offsets[i];
+    get_byte(segment, &tag);
+    get_varint(segment, &frame);
+    get_varint(segment, &last_cycles);
+    get_u64(segment, &hash);
+
+    machines[i] = InitMachineFromPool(pool);
+    MachineLoadSnapshot(machines[i], &segment->data[segment->pos]);
+    segment->pos += MACHINE_SNAPSHOT_SIZE;
+    segment->frames = frame;
+    first_frame[i] = frame;
+    segment->last_cycles = last_cycles;
+    segment->mismatch = 0;
+    machines[i]->log = segment;
+    if (Hash8080(machines[i]->state) != hash)
+    {
+      set_mismatch(segment, "snapshot");
+    }
+
+    //the last segment runs to the end of the session
+    if (i + 1 < num_snapshots)
+    {
+      InputLog next = *log;
+      next.pos = offsets[i + 1] + 1;
+      get_varint(&next, &segment->total_frames);
+    }
+    frames[i] = segment->total_frames - frame;
+  }
+
+  //corrupt snapshots get no frames to run
+  for (i = 0; i < num_snapshots; i++)
+  {
+    if (segments[i].mismatch)
+    {
+      frames[i] = 0;
+    }
+  }
+  RunFleet(machines, frames, num_snapshots, workers, MACHINE_FRAMES_PER_SEC, NULL);
+
+  for (i = 0; i < num_snapshots; i++)
+  {
+    InputLog *segment = &segments[i];
+    size_t end = (i + 1 < num_snapshots) ? offsets[i + 1] : log->size;
+
+    if (!segment->mismatch && segment->frames != segment->total_frames)
+    {
+      set_mismatch(segment, "halt");
+    }
+    //the next snapshot record was checked and stepped over by the last frame
+    if (i + 1 < num_snapshots && !segment->mismatch)
+    {
+      InputLog next = *log;
+      next.pos = offsets[i + 1];
+      skip_record(&next);
+      end = next.pos;
+    }
+    if (!segment->mismatch && segment->pos != end)
+    {
+      set_mismatch(segment, "input count");
+    }
+
+    if (segment->mismatch)
+    {
+      printf("segment %d (frames %llu-%llu): mismatch at frame %llu\n", i,
+             (unsigned long long) first_frame[i],
+             (unsigned long long) segment->total_frames,
+             (unsigned long long) segment->mismatch_frame);
+      ok = 0;
+    }
+    FreeMachine(machines[i]);
+  }
+
+  log->frames = log->total_frames;
+  DestroyCpuPool(pool);
+  free(first_frame);
+  free(frames);
+  free(machines);
+  free(segments);
+  free(offsets);
+  return ok;
+}
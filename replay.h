@@ -0,0 +1,63 @@
+#ifndef I8080_REPLAY_H
+#define I8080_REPLAY_H
+
+#include <stdint.h>
+
+#include "machine.h"
+
+// Input log: every IN a machine executes, plus periodic state hashes and
+// optional full machine snapshots.
+//
+// Records are a tag byte followed by varints, cycle stamps are stored as
+// deltas, so a typical session costs a few bytes per input read. Because the
+// machine is deterministic, feeding the logged values back at the logged
+// cycles reproduces the session exactly, which the hashes verify. Snapshots
+// split the session into segments that can be replayed independently.
+struct InputLog {
+  uint8_t  *data;
+  size_t   size;
+  size_t   capacity;
+  size_t   pos;             // read position while replaying
+  uint64_t last_cycles;     // cycle stamp of the previous input record
+  uint32_t hash_interval;   // frames between state hashes, 0 for none
+  uint32_t snapshot_interval; // frames between snapshots, 0 for none
+  uint64_t frames;          // frames recorded or replayed so far
+  uint64_t total_frames;    // frames in a loaded log
+  int      replaying;
+  int      mismatch;        // set once replay diverged
+  uint64_t mismatch_frame;  // frame where divergence was detected
+};
+
+// Start an empty log for recording.
+InputLog* CreateInputLog(uint32_t hash_interval, uint32_t snapshot_interval);
+// Read a log from disk for replay, NULL on error.
+InputLog* LoadInputLog(const char *filename);
+//   @return: 0 on error
+int SaveInputLog(InputLog *log, const char *filename);
+void FreeInputLog(InputLog *log);
+
+// Hook the log into a machine and hash its starting state, so replays
+// on a machine with a different ROM are caught at frame 0.
+//   @return: 0 if a replayed machine does not match the recording
+int InputLogAttach(InputLog *log, Machine *machine);
+
+// Called by the machine on every IN.
+//   @return: the value to load into A
+uint8_t InputLogRead(InputLog *log, Machine *machine, uint8_t port, uint8_t value);
+
+// Called by the machine at the end of every frame.
+void InputLogFrame(InputLog *log, Machine *machine);
+
+// Attach the log to a fresh machine and replay it as fast as possible.
+//   @return: 1 if every input and hash matched
+int ReplayInputLog(InputLog *log, Machine *machine);
+
+// Replay the segments between snapshots concurrently on a fleet.
+// Each segment starts from its snapshot and must end on the state hash of
+// the next one; mismatching segments are reported with the frame at which
+// they diverged.
+//   workers: threads to use, 0 for one per core
+//   @return: 1 if every segment matched
+int ReplayInputLogParallel(InputLog *log, int workers);
+
+#endif /* I8080_REPLAY_H */
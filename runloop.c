@@ -0,0 +1,18 @@
+#include "runloop.h"
+#include "disassembler.h"
+
+DEFINE_RUN_LOOP(RunLoopPlain, void, no_hook, no_hook)
+
+static inline int trace_before(CpuState *state, void *ctx)
+{
+  Disassemble8080Op(state->memory, state->pc);
+  return HOOK_CONTINUE;
+}
+
+static inline int trace_after(CpuState *state, void *ctx)
+{
+  print_state(state);
+  return HOOK_CONTINUE;
+}
+
+DEFINE_RUN_LOOP(RunLoopTrace, void, trace_before, trace_after)
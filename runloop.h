@@ -0,0 +1,56 @@
+#ifndef I8080_RUNLOOP_H
+#define I8080_RUNLOOP_H
+
+#include <stdint.h>
+
+#include "emulator.h"
+
+// Run loops are generated per mode, so debug features cost nothing in the
+// plain loop: each mode supplies a `before` and `after` hook, written as
+// static inline functions, and gets its own copy of the loop with the hooks
+// inlined. A hook that just returns HOOK_CONTINUE compiles away entirely.
+
+// Hook results
+#define HOOK_CONTINUE 0   // execute the instruction as usual
+#define HOOK_SKIP     1   // the hook handled the instruction itself
+#define HOOK_STOP     2   // leave the run loop
+
+// Define `uint64_t name(CpuState *state, uint64_t steps, ctx_type *ctx)`,
+// which runs up to `steps` instructions and returns how many it ran.
+#define DEFINE_RUN_LOOP(name, ctx_type, before, after)                  \
+  uint64_t name(CpuState *state, uint64_t steps, ctx_type *ctx)         \
+  {                                                                     \
+    uint64_t n;                                                         \
+    for (n = 0; n < steps && !state->halted; n++)                       \
+    {                                                                   \
+      int hook = before(state, ctx);                                    \
+      if (hook == HOOK_STOP)                                            \
+      {                                                                 \
+        break;                                                          \
+      }                                                                 \
+      if (hook == HOOK_CONTINUE)                                        \
+      {                                                                 \
+        Emulate8080Op(state);                                           \
+      }                                                                 \
+      if (after(state, ctx) == HOOK_STOP)                               \
+      {                                                                 \
+        n++;                                                            \
+        break;                                                          \
+      }                                                                 \
+    }                                                                   \
+    return n;                                                           \
+  }
+
+// Hook that does nothing, for modes that only need one side
+static inline int no_hook(CpuState *state, void *ctx)
+{
+  return HOOK_CONTINUE;
+}
+
+// Production loop, no instrumentation.
+uint64_t RunLoopPlain(CpuState *state, uint64_t steps, void *ctx);
+
+// Tracing loop: disassembles every instruction and prints the registers.
+uint64_t RunLoopTrace(CpuState *state, uint64_t steps, void *ctx);
+
+#endif /* I8080_RUNLOOP_H */
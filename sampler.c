@@ -0,0 +1,221 @@
+#include "sampler.h"
+
+Sampler* CreateSampler(uint32_t interval, uint32_t seed)
+{
+  Sampler *sampler = calloc(1, sizeof(Sampler));
+  sampler->interval = interval ? interval : 1;
+  sampler->random = seed ? seed : 8080;
+  sampler->next = sampler->interval;
+  return sampler;
+}
+
+void FreeSampler(Sampler *sampler)
+{
+  free(sampler);
+}
+
+static uint32_t xorshift(Sampler *sampler)
+{
+  uint32_t x = sampler->random;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sampler->random = x;
+  return x;
+}
+
+static uint32_t hash_sample(const Sample *sample)
+{
+  uint32_t h = sample->pc * 0x9e3779b1u ^ sample->irq;
+  int i;
+
+  for (i = 0; i < sample->depth; i++)
+  {
+    h = (h ^ sample->callers[i]) * 0x01000193u;
+  }
+  return h ^ (h >> 15);
+}
+
+static int same_stack(const Sample *a, const Sample *b)
+{
+  return a->pc == b->pc && a->irq == b->irq && a->depth == b->depth &&
+         memcmp(a->callers, b->callers, a->depth * sizeof(uint16_t)) == 0;
+}
+
+/* Add `count` samples of a stack, linear probing from its hash */
+static void add_sample(Sampler *sampler, const Sample *sample, uint64_t count)
+{
+  uint32_t slot = hash_sample(sample) & (SAMPLE_TABLE_SIZE - 1);
+  int probes;
+
+  sampler->samples += count;
+  for (probes = 0; probes < SAMPLE_TABLE_SIZE; probes++)
+  {
+    Sample *entry = &sampler->table[slot];
+    if (entry->count == 0)
+    {
+      *entry = *sample;
+      entry->count = count;
+      sampler->used++;
+      return;
+    }
+    if (same_stack(entry, sample))
+    {
+      entry->count += count;
+      return;
+    }
+    slot = (slot + 1) & (SAMPLE_TABLE_SIZE - 1);
+  }
+  sampler->dropped += count;
+}
+
+static void take_sample(Sampler *sampler, CpuState *state)
+{
+  uint8_t *memory = state->memory;
+  Sample sample;
+  uint32_t sp = state->sp;
+  uint32_t top = sp + 2 * SAMPLE_SCAN;
+
+  //the interrupt is over once its return address has been popped
+  if (sampler->irq && sp > sampler->irq_sp)
+  {
+    sampler->irq = 0;
+  }
+
+  // Inside an interrupt only its own part of the stack is searched
+  if (sampler->irq && top > sampler->irq_sp)
+  {
+    top = sampler->irq_sp;
+  }
+
+  memset(&sample, 0, sizeof(sample));
+  sample.pc = state->pc;
+  sample.irq = sampler->irq;
+  for (; sp < top && sp + 1 < I8080_MEMORY_SIZE && sample.depth < SAMPLE_DEPTH; sp += 2)
+  {
+    uint16_t ret = memory[sp] | (memory[sp + 1] << 8);
+    uint8_t call = memory[(uint16_t) (ret - 3)];
+    if (ret >= 3 && (call == 0xcd || (call & 0xc7) == 0xc4))
+    {
+      sample.callers[sample.depth++] = memory[ret - 2] | (memory[ret - 1] << 8);
+    }
+  }
+  add_sample(sampler, &sample, 1);
+
+  sampler->next = state->cycles + sampler->interval / 2 +
+                  xorshift(sampler) % sampler->interval;
+}
+
+/* Run straight to whichever comes first, the sample or the interrupt */
+static inline uint64_t sampler_limit(Machine *machine, Sampler *sampler,
+                                     uint64_t end)
+{
+  if (machine->state->cycles >= sampler->next)
+  {
+    take_sample(sampler, machine->state);
+  }
+  return sampler->next < end ? sampler->next : end;
+}
+
+/* The interrupt has just pushed pc and jumped to its RST vector */
+static inline int sampler_interrupt(Machine *machine, Sampler *sampler)
+{
+  sampler->irq = machine->state->pc / 8;
+  sampler->irq_sp = machine->state->sp;
+  return HOOK_CONTINUE;
+}
+
+DEFINE_MACHINE_RUN_FRAME(MachineRunFrameSampled, Sampler,
+                         no_machine_hook, no_machine_hook, sampler_interrupt,
+                         sampler_limit)
+
+void MergeSamples(Sampler *into, const Sampler *from)
+{
+  int i;
+
+  for (i = 0; i < SAMPLE_TABLE_SIZE; i++)
+  {
+    if (from->table[i].count)
+    {
+      add_sample(into, &from->table[i], from->table[i].count);
+    }
+  }
+  into->dropped += from->dropped;
+}
+
+static int by_count(const void *a, const void *b)
+{
+  uint64_t x = ((const Sample *) a)->count;
+  uint64_t y = ((const Sample *) b)->count;
+  return (x < y) - (x > y);
+}
+
+void PrintSamples(Sampler *sampler, int top)
+{
+  Sample *sorted = malloc(SAMPLE_TABLE_SIZE * sizeof(Sample));
+  int count = 0;
+  int i, j;
+
+  for (i = 0; i < SAMPLE_TABLE_SIZE; i++)
+  {
+    if (sampler->table[i].count)
+    {
+      sorted[count++] = sampler->table[i];
+    }
+  }
+  qsort(sorted, count, sizeof(Sample), by_count);
+
+  printf("%llu samples every %u cycles or so, %d stacks, %llu dropped\n",
+         (unsigned long long) sampler->samples, sampler->interval, count,
+         (unsigned long long) sampler->dropped);
+  printf("%10s %6s  %-5s %-5s  callers\n", "samples", "share", "irq", "pc");
+  for (i = 0; i < count && i < top; i++)
+  {
+    Sample *sample = &sorted[i];
+    printf("%10llu %5.1f%%  ", (unsigned long long) sample->count,
+           100.0 * sample->count / sampler->samples);
+    if (sample->irq)
+    {
+      printf("rst %d ", sample->irq);
+    }
+    else
+    {
+      printf("%-5s ", "-");
+    }
+    printf("$%04x ", sample->pc);
+    for (j = 0; j < sample->depth; j++)
+    {
+      printf(" < $%04x", sample->callers[j]);
+    }
+    printf("\n");
+  }
+  free(sorted);
+}
+
+void WriteSampleStacks(Sampler *sampler, FILE *out)
+{
+  int i, j;
+
+  for (i = 0; i < SAMPLE_TABLE_SIZE; i++)
+  {
+    Sample *sample = &sampler->table[i];
+    if (sample->count == 0)
+    {
+      continue;
+    }
+    if (sample->irq)
+    {
+      fprintf(out, "irq%d;", sample->irq);
+    }
+    else
+    {
+      fprintf(out, "main;");
+    }
+    for (j = sample->depth - 1; j >= 0; j--)
+    {
+      fprintf(out, "sub_%04x;", sample->callers[j]);
+    }
+    fprintf(out, "pc_%04x %llu\n", sample->pc, (unsigned long long) sample->count);
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef I8080_SAMPLER_H
+#define I8080_SAMPLER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// Sampling profiler on the emulated cycle counter.
+//
+// Every `interval` cycles, give or take half of it at random, a sample
+// records pc, the interrupt being serviced and the innermost few callers.
+// MachineRunFrameSampled runs the instructions between samples with the
+// same loop as MachineRunFrame: the next sample time just lowers the cycle
+// count the frame loop already checks against, so instructions cost nothing
+// extra and each sample is one stack walk and a hash table update.
+//
+// There is no shadow stack without tracking every CALL and RET, so callers
+// come from the emulated stack: words above SP that are return addresses
+// of a CALL or Ccc name the subroutine that was called. Data pushed on the
+// stack can pass for a return address now and then.
+//
+// Samples with the same pc, interrupt and callers share a slot in a fixed
+// size hash table; samples that find it full are counted as dropped.
+
+#define SAMPLE_DEPTH      4      // callers kept per sample
+#define SAMPLE_SCAN       16     // stack words searched for them
+#define SAMPLE_TABLE_SIZE 4096   // slots, a power of two
+
+typedef struct {
+  uint64_t count;                // 0 for a free slot
+  uint16_t pc;
+  uint16_t callers[SAMPLE_DEPTH];  // called subroutines, innermost first
+  uint8_t  depth;
+  uint8_t  irq;                  // RST number being serviced, 0 for none
+} Sample;
+
+struct Sampler {
+  Sample   table[SAMPLE_TABLE_SIZE];
+  int      used;
+  uint64_t samples;
+  uint64_t dropped;
+
+  uint32_t interval;
+  uint64_t next;                 // cycle count of the next sample
+  uint32_t random;               // xorshift state for the jitter
+
+  // interrupt in progress: its number and SP right after it pushed pc
+  uint8_t  irq;
+  uint16_t irq_sp;
+};
+
+Sampler* CreateSampler(uint32_t interval, uint32_t seed);
+void FreeSampler(Sampler *sampler);
+
+// MachineRunFrame, sampling every `interval` cycles or so.
+int MachineRunFrameSampled(Machine *machine, Sampler *sampler);
+
+// Add the samples of `from` into `into`.
+void MergeSamples(Sampler *into, const Sampler *from);
+
+// Print the `top` most sampled stacks.
+void PrintSamples(Sampler *sampler, int top);
+
+// Write "irq2;sub_0100;sub_0200;pc_0234 count" lines, rooted at "main"
+// outside interrupts: the collapsed stack format flamegraph.pl reads.
+void WriteSampleStacks(Sampler *sampler, FILE *out);
+
+#endif /* I8080_SAMPLER_H */
@@ -0,0 +1,159 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <strings.h>
+#include <time.h>
+
+#include "cpm.h"
+#include "fleet.h"
+
+// Stop runaway programs; 8080EXM needs a few billion instructions
+#define DEFAULT_MAX_INSTRUCTIONS 20000000000ULL
+
+typedef struct {
+  char     path[512];
+  char     *output;
+  size_t   output_size;
+  uint64_t instructions;
+  double   seconds;
+  int      passed;
+  const char *reason;
+} TestResult;
+
+static TestResult *tests;    // grown as the directory is read
+static int num_tests;
+static atomic_int next_test;
+static uint64_t max_instructions = DEFAULT_MAX_INSTRUCTIONS;
+
+static int has_suffix(const char *name, const char *suffix)
+{
+  size_t n = strlen(name), m = strlen(suffix);
+  return (n >= m) && (strcasecmp(name + n - m, suffix) == 0);
+}
+
+static void run_test(TestResult *test)
+{
+  struct timespec start, end;
+  FILE *out = open_memstream(&test->output, &test->output_size);
+  CpmMachine *cpm = InitCpm(out);
+
+  CpmLoad(cpm, test->path);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test->instructions = RunLoopCpm(cpm->state, max_instructions, cpm);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  test->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  CpmFlush(cpm);
+  fclose(out);
+
+  test->reason = CpmVerdict(cpm, test->output);
+  test->passed = test->reason == NULL;
+  if (test->passed)
+  {
+    test->reason = "";
+  }
+  FreeCpm(cpm);
+}
+
+static void *worker(void *arg)
+{
+  int i;
+  while ((i = atomic_fetch_add(&next_test, 1)) < num_tests)
+  {
+    run_test(&tests[i]);
+  }
+  return NULL;
+}
+
+static int by_path(const void *a, const void *b)
+{
+  return strcmp(((const TestResult *) a)->path, ((const TestResult *) b)->path);
+}
+
+int main (int argc, char** argv)
+{
+  const char *dirname = ".";
+  int verbose = 0;
+  int i, failed = 0;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-v") == 0)
+    {
+      verbose = 1;
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      max_instructions = strtoull(argv[++i], NULL, 0);
+    }
+    else
+    {
+      dirname = argv[i];
+    }
+  }
+
+  //every .COM file in the directory, plus cpudiag.bin
+  DIR *dir = opendir(dirname);
+  if (dir == NULL)
+  {
+    printf("error: Couldn't open %s\n", dirname);
+    return 1;
+  }
+  struct dirent *entry;
+  int capacity = 0;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    if (has_suffix(entry->d_name, ".com") || strcmp(entry->d_name, "cpudiag.bin") == 0)
+    {
+      if (num_tests == capacity)
+      {
+        capacity = capacity ? 2 * capacity : 64;
+        tests = realloc(tests, capacity * sizeof(TestResult));
+      }
+      memset(&tests[num_tests], 0, sizeof(TestResult));
+      snprintf(tests[num_tests].path, sizeof(tests[num_tests].path), "%s/%s",
+               dirname, entry->d_name);
+      num_tests++;
+    }
+  }
+  closedir(dir);
+  qsort(tests, num_tests, sizeof(TestResult), by_path);
+
+  //one program per core
+  int workers = FleetNumCores();
+  if (workers > num_tests)
+  {
+    workers = num_tests;
+  }
+  pthread_t threads[workers > 0 ? workers : 1];
+  for (i = 0; i < workers; i++)
+  {
+    pthread_create(&threads[i], NULL, worker, NULL);
+  }
+  for (i = 0; i < workers; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("%-24s %-6s %16s %10s %10s\n", "test", "result", "instructions",
+         "seconds", "MIPS");
+  for (i = 0; i < num_tests; i++)
+  {
+    TestResult *test = &tests[i];
+    double mips = (test->seconds > 0) ? test->instructions / test->seconds / 1e6 : 0;
+    printf("%-24s %-6s %16llu %10.3f %10.2f  %s\n", test->path,
+           test->passed ? "PASS" : "FAIL", (unsigned long long) test->instructions,
+           test->seconds, mips, test->reason);
+    if (verbose)
+    {
+      fwrite(test->output, 1, test->output_size, stdout);
+      printf("\n");
+    }
+    failed += !test->passed;
+    free(test->output);
+  }
+  free(tests);
+  printf("%d of %d passed\n", num_tests - failed, num_tests);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,600 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "disassembler.h"
+
+static const char trace_magic[8] = "8080TRC1";
+static const char index_magic[8] = "8080TIDX";
+
+#define HASH_BASIS 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+/* Encoding helpers, `p` is advanced past what was written */
+static inline uint8_t* put_varint(uint8_t *p, uint64_t x)
+{
+  while (x >= 0x80)
+  {
+    *p++ = (x & 0x7f) | 0x80;
+    x >>= 7;
+  }
+  *p++ = x;
+  return p;
+}
+
+// Small negative deltas as small varints
+static inline uint64_t zigzag(int32_t x)
+{
+  return ((uint32_t) x << 1) ^ (uint32_t) (x >> 31);
+}
+
+static inline int32_t unzigzag(uint64_t x)
+{
+  return (int32_t) (x >> 1) ^ -(int32_t) (x & 1);
+}
+
+static inline uint8_t pack_flags(CpuState *state)
+{
+  return state->cc.z | state->cc.s << 1 | state->cc.p << 2 |
+         state->cc.cy << 3 | state->cc.ac << 4;
+}
+
+static inline void unpack_flags(CpuState *state, uint8_t flags)
+{
+  state->cc.z = flags & 1;
+  state->cc.s = (flags >> 1) & 1;
+  state->cc.p = (flags >> 2) & 1;
+  state->cc.cy = (flags >> 3) & 1;
+  state->cc.ac = (flags >> 4) & 1;
+}
+
+static void put_u64(FILE *file, uint64_t x)
+{
+  int i;
+  for (i = 0; i < 8; i++)
+  {
+    fputc((x >> (8 * i)) & 0xff, file);
+  }
+}
+
+static uint64_t read_u64(const uint8_t *p)
+{
+  uint64_t x = 0;
+  int i;
+  for (i = 0; i < 8; i++)
+  {
+    x |= (uint64_t) p[i] << (8 * i);
+  }
+  return x;
+}
+
+/* Writer thread */
+
+// Chain the hash over a buffer a word at a time, the tail zero padded
+static uint64_t hash_buffer(uint64_t hash, const uint8_t *data, size_t size)
+{
+  uint64_t word;
+  size_t i;
+
+  for (i = 0; i + sizeof(word) <= size; i += sizeof(word))
+  {
+    memcpy(&word, &data[i], sizeof(word));
+    hash = (hash ^ word) * HASH_PRIME;
+  }
+  if (i < size)
+  {
+    word = 0;
+    memcpy(&word, &data[i], size - i);
+    hash = (hash ^ word) * HASH_PRIME;
+  }
+  return hash;
+}
+
+static void write_buffer(TraceWriter *trace, int b)
+{
+  if (trace->checkpoints == trace->index_capacity)
+  {
+    trace->index_capacity = trace->index_capacity ? trace->index_capacity * 2 : 1024;
+    trace->index = realloc(trace->index,
+                           trace->index_capacity * sizeof(TraceCheckpoint));
+  }
+
+  trace->hash = hash_buffer(trace->hash, trace->data[b], trace->size[b]);
+
+  TraceCheckpoint *checkpoint = &trace->index[trace->checkpoints++];
+  checkpoint->instruction = trace->first[b];
+  checkpoint->offset = trace->offset;
+  checkpoint->size = trace->size[b];
+  checkpoint->hash = trace->hash;
+
+  if (fwrite(trace->data[b], 1, trace->size[b], trace->file) != trace->size[b])
+  {
+    trace->error = 1;
+  }
+  trace->offset += trace->size[b];
+}
+
+static void* writer_thread(void *arg)
+{
+  TraceWriter *trace = arg;
+
+  pthread_mutex_lock(&trace->lock);
+  for (;;)
+  {
+    while (trace->filled == 0 && !trace->closing)
+    {
+      pthread_cond_wait(&trace->ready, &trace->lock);
+    }
+    if (trace->filled == 0)
+    {
+      break;
+    }
+
+    int b = trace->head;
+    pthread_mutex_unlock(&trace->lock);
+    write_buffer(trace, b);
+    pthread_mutex_lock(&trace->lock);
+
+    trace->head = (trace->head + 1) % TRACE_BUFFERS;
+    trace->filled--;
+    pthread_cond_signal(&trace->drained);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return NULL;
+}
+
+TraceWriter* CreateTraceWriter(const char *filename)
+{
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL)
+  {
+    printf("error: cannot write %s\n", filename);
+    return NULL;
+  }
+
+  TraceWriter *trace = calloc(1, sizeof(TraceWriter));
+  int i;
+
+  for (i = 0; i < TRACE_BUFFERS; i++)
+  {
+    trace->data[i] = malloc(TRACE_BUFFER_SIZE);
+  }
+  trace->file = file;
+  trace->hash = HASH_BASIS;
+
+  fwrite(trace_magic, 1, sizeof(trace_magic), file);
+  for (i = 0; i < 4; i++)
+  {
+    fputc((TRACE_BUFFER_SIZE >> (8 * i)) & 0xff, file);
+  }
+  trace->offset = TRACE_HEADER_SIZE;
+
+  pthread_mutex_init(&trace->lock, NULL);
+  pthread_cond_init(&trace->ready, NULL);
+  pthread_cond_init(&trace->drained, NULL);
+  pthread_create(&trace->writer, NULL, writer_thread, trace);
+  return trace;
+}
+
+/* Hand the current buffer to the writer and move to the next free one */
+static void submit_buffer(TraceWriter *trace)
+{
+  pthread_mutex_lock(&trace->lock);
+  trace->size[trace->current] = trace->pos;
+  trace->filled++;
+  pthread_cond_signal(&trace->ready);
+
+  trace->current = (trace->current + 1) % TRACE_BUFFERS;
+  while (trace->filled == TRACE_BUFFERS)
+  {
+    pthread_cond_wait(&trace->drained, &trace->lock);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  trace->pos = 0;
+}
+
+int CloseTraceWriter(TraceWriter *trace)
+{
+  int i;
+
+  if (trace->pos > 0)
+  {
+    submit_buffer(trace);
+  }
+  pthread_mutex_lock(&trace->lock);
+  trace->closing = 1;
+  pthread_cond_signal(&trace->ready);
+  pthread_mutex_unlock(&trace->lock);
+  pthread_join(trace->writer, NULL);
+
+  uint64_t index_offset = trace->offset;
+  uint64_t c;
+  for (c = 0; c < trace->checkpoints; c++)
+  {
+    put_u64(trace->file, trace->index[c].instruction);
+    put_u64(trace->file, trace->index[c].offset);
+    put_u64(trace->file, trace->index[c].size);
+    put_u64(trace->file, trace->index[c].hash);
+  }
+  put_u64(trace->file, index_offset);
+  put_u64(trace->file, trace->checkpoints);
+  put_u64(trace->file, trace->instructions);
+  fwrite(index_magic, 1, sizeof(index_magic), trace->file);
+
+  int ok = !trace->error && !ferror(trace->file);
+  if (fclose(trace->file) != 0)
+  {
+    ok = 0;
+  }
+
+  pthread_mutex_destroy(&trace->lock);
+  pthread_cond_destroy(&trace->ready);
+  pthread_cond_destroy(&trace->drained);
+  for (i = 0; i < TRACE_BUFFERS; i++)
+  {
+    free(trace->data[i]);
+  }
+  free(trace->index);
+  free(trace);
+  return ok;
+}
+
+/* Recording */
+
+static void put_keyframe(TraceWriter *trace, CpuState *state)
+{
+  uint8_t *p = trace->data[trace->current] + trace->pos;
+
+  trace->first[trace->current] = trace->instructions;
+  *p++ = TRACE_EXT;
+  *p++ = TRACE_KEY;
+  p = put_varint(p, trace->instructions);
+  p = put_varint(p, state->cycles);
+  *p++ = state->pc & 0xff;
+  *p++ = state->pc >> 8;
+  *p++ = state->a;
+  *p++ = state->b;
+  *p++ = state->c;
+  *p++ = state->d;
+  *p++ = state->e;
+  *p++ = state->h;
+  *p++ = state->l;
+  *p++ = pack_flags(state);
+  *p++ = state->sp & 0xff;
+  *p++ = state->sp >> 8;
+  *p++ = state->int_enable;
+  trace->pos = p - trace->data[trace->current];
+
+  trace->last = *state;
+}
+
+static inline void trace_instruction(TraceWriter *trace, CpuState *state)
+{
+  CpuState *last = &trace->last;
+
+  if (trace->pos + TRACE_MAX_RECORD > TRACE_BUFFER_SIZE)
+  {
+    submit_buffer(trace);
+  }
+  if (trace->pos == 0)
+  {
+    put_keyframe(trace, state);
+  }
+
+  uint8_t *p = trace->data[trace->current] + trace->pos;
+  uint8_t *mask = p++;
+  uint8_t flags = pack_flags(state);
+  uint8_t ext = 0;
+
+  *mask = (state->a != last->a) * TRACE_A | (state->b != last->b) * TRACE_B |
+          (state->c != last->c) * TRACE_C | (state->d != last->d) * TRACE_D |
+          (state->e != last->e) * TRACE_E | (state->h != last->h) * TRACE_H |
+          (state->l != last->l) * TRACE_L;
+  ext = (flags != pack_flags(last)) * TRACE_FLAGS |
+        (state->sp != last->sp) * TRACE_SP |
+        (state->int_enable != last->int_enable) * TRACE_INTE;
+  if (ext)
+  {
+    *mask |= TRACE_EXT;
+    *p++ = ext;
+  }
+
+  p = put_varint(p, zigzag((int16_t) (state->pc - last->pc)));
+  uint8_t *code = &state->memory[state->pc];
+  int length = Length8080Op(code[0]);
+  *p++ = code[0];
+  if (length > 1)
+  {
+    *p++ = state->memory[(uint16_t) (state->pc + 1)];
+  }
+  if (length > 2)
+  {
+    *p++ = state->memory[(uint16_t) (state->pc + 2)];
+  }
+
+  if (*mask & TRACE_A) *p++ = state->a;
+  if (*mask & TRACE_B) *p++ = state->b;
+  if (*mask & TRACE_C) *p++ = state->c;
+  if (*mask & TRACE_D) *p++ = state->d;
+  if (*mask & TRACE_E) *p++ = state->e;
+  if (*mask & TRACE_H) *p++ = state->h;
+  if (*mask & TRACE_L) *p++ = state->l;
+  if (ext & TRACE_FLAGS)
+  {
+    *p++ = flags;
+  }
+  if (ext & TRACE_SP)
+  {
+    p = put_varint(p, zigzag((int16_t) (state->sp - last->sp)));
+  }
+  if (ext & TRACE_INTE)
+  {
+    *p++ = state->int_enable;
+  }
+  trace->pos = p - trace->data[trace->current];
+  trace->instructions++;
+
+  last->a = state->a;
+  last->b = state->b;
+  last->c = state->c;
+  last->d = state->d;
+  last->e = state->e;
+  last->h = state->h;
+  last->l = state->l;
+  last->cc = state->cc;
+  last->sp = state->sp;
+  last->pc = state->pc;
+  last->int_enable = state->int_enable;
+}
+
+void TraceInstruction(TraceWriter *trace, CpuState *state)
+{
+  trace_instruction(trace, state);
+}
+
+static inline int trace_before(Machine *machine, TraceWriter *trace)
+{
+  trace_instruction(trace, machine->state);
+  return HOOK_CONTINUE;
+}
+
+DEFINE_MACHINE_RUN_FRAME(MachineRunFrameTraced, TraceWriter,
+                         trace_before, no_machine_hook, no_machine_hook,
+                         no_machine_limit)
+
+/* Reading */
+
+TraceFile* OpenTraceFile(const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    printf("error: cannot open %s\n", filename);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return NULL;
+  }
+
+  size_t size = st.st_size;
+  const uint8_t *data = NULL;
+  if (size >= TRACE_HEADER_SIZE + TRACE_FOOTER_SIZE)
+  {
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == NULL || data == MAP_FAILED)
+  {
+    printf("error: %s is not a trace\n", filename);
+    return NULL;
+  }
+
+  const uint8_t *footer = data + size - TRACE_FOOTER_SIZE;
+  uint64_t index_offset = read_u64(footer);
+  uint64_t checkpoints = read_u64(footer + 8);
+  if (memcmp(data, trace_magic, sizeof(trace_magic)) != 0 ||
+      memcmp(footer + 24, index_magic, sizeof(index_magic)) != 0 ||
+      index_offset < TRACE_HEADER_SIZE ||
+      index_offset + checkpoints * 32 != size - TRACE_FOOTER_SIZE)
+  {
+    printf("error: %s is not a complete trace\n", filename);
+    munmap((void *) data, size);
+    return NULL;
+  }
+
+  TraceFile *trace = calloc(1, sizeof(TraceFile));
+  uint64_t c;
+
+  trace->data = data;
+  trace->size = size;
+  trace->buffer_size = data[8] | data[9] << 8 | data[10] << 16 | data[11] << 24;
+  trace->checkpoints = checkpoints;
+  trace->instructions = read_u64(footer + 16);
+  trace->index = malloc((checkpoints ? checkpoints : 1) * sizeof(TraceCheckpoint));
+  for (c = 0; c < checkpoints; c++)
+  {
+    const uint8_t *entry = data + index_offset + c * 32;
+    trace->index[c].instruction = read_u64(entry);
+    trace->index[c].offset = read_u64(entry + 8);
+    trace->index[c].size = read_u64(entry + 16);
+    trace->index[c].hash = read_u64(entry + 24);
+  }
+  return trace;
+}
+
+void CloseTraceFile(TraceFile *trace)
+{
+  munmap((void *) trace->data, trace->size);
+  free(trace->index);
+  free(trace);
+}
+
+void TraceSeek(TraceCursor *cursor, const TraceFile *trace, uint64_t checkpoint)
+{
+  cursor->trace = trace;
+  cursor->checkpoint = checkpoint;
+  cursor->pos = 0;
+  cursor->end = 0;
+  if (checkpoint < trace->checkpoints)
+  {
+    cursor->pos = trace->index[checkpoint].offset;
+    cursor->end = cursor->pos + trace->index[checkpoint].size;
+  }
+  cursor->next = checkpoint < trace->checkpoints ?
+                 trace->index[checkpoint].instruction : trace->instructions;
+  cursor->state.memory = cursor->memory;
+}
+
+static inline int get_byte(TraceCursor *cursor, uint8_t *x)
+{
+  if (cursor->pos >= cursor->end)
+  {
+    return 0;
+  }
+  *x = cursor->trace->data[cursor->pos++];
+  return 1;
+}
+
+static int get_varint(TraceCursor *cursor, uint64_t *x)
+{
+  uint8_t byte;
+  int shift = 0;
+
+  *x = 0;
+  do
+  {
+    if (!get_byte(cursor, &byte) || shift > 63)
+    {
+      return 0;
+    }
+    *x |= (uint64_t) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return 1;
+}
+
+static int get_keyframe(TraceCursor *cursor)
+{
+  CpuState *state = &cursor->state;
+  uint8_t bytes[13];
+  int i;
+
+  if (!get_varint(cursor, &cursor->next) || !get_varint(cursor, &state->cycles))
+  {
+    return 0;
+  }
+  for (i = 0; i < 13; i++)
+  {
+    if (!get_byte(cursor, &bytes[i]))
+    {
+      return 0;
+    }
+  }
+  state->pc = bytes[0] | bytes[1] << 8;
+  state->a = bytes[2];
+  state->b = bytes[3];
+  state->c = bytes[4];
+  state->d = bytes[5];
+  state->e = bytes[6];
+  state->h = bytes[7];
+  state->l = bytes[8];
+  unpack_flags(state, bytes[9]);
+  state->sp = bytes[10] | bytes[11] << 8;
+  state->int_enable = bytes[12];
+  return 1;
+}
+
+int TraceNext(TraceCursor *cursor)
+{
+  CpuState *state = &cursor->state;
+  uint8_t mask, ext = 0;
+  uint64_t x;
+
+  for (;;)
+  {
+    if (cursor->pos >= cursor->end)
+    {
+      if (cursor->checkpoint + 1 >= cursor->trace->checkpoints)
+      {
+        return 0;
+      }
+      TraceSeek(cursor, cursor->trace, cursor->checkpoint + 1);
+    }
+
+    cursor->record = cursor->pos;
+    ext = 0;
+    if (!get_byte(cursor, &mask) || ((mask & TRACE_EXT) && !get_byte(cursor, &ext)))
+    {
+      return 0;
+    }
+    if (!(ext & TRACE_KEY))
+    {
+      break;
+    }
+    if (!get_keyframe(cursor))
+    {
+      return 0;
+    }
+  }
+
+  if (!get_varint(cursor, &x))
+  {
+    return 0;
+  }
+  state->pc += unzigzag(x);
+
+  uint8_t *code = &cursor->memory[state->pc];
+  int length, i;
+  if (!get_byte(cursor, &code[0]))
+  {
+    return 0;
+  }
+  length = Length8080Op(code[0]);
+  for (i = 1; i < length; i++)
+  {
+    if (!get_byte(cursor, &code[i]))
+    {
+      return 0;
+    }
+  }
+
+  if (((mask & TRACE_A) && !get_byte(cursor, &state->a)) ||
+      ((mask & TRACE_B) && !get_byte(cursor, &state->b)) ||
+      ((mask & TRACE_C) && !get_byte(cursor, &state->c)) ||
+      ((mask & TRACE_D) && !get_byte(cursor, &state->d)) ||
+      ((mask & TRACE_E) && !get_byte(cursor, &state->e)) ||
+      ((mask & TRACE_H) && !get_byte(cursor, &state->h)) ||
+      ((mask & TRACE_L) && !get_byte(cursor, &state->l)))
+  {
+    return 0;
+  }
+  if (ext & TRACE_FLAGS)
+  {
+    uint8_t flags;
+    if (!get_byte(cursor, &flags))
+    {
+      return 0;
+    }
+    unpack_flags(state, flags);
+  }
+  if (ext & TRACE_SP)
+  {
+    if (!get_varint(cursor, &x))
+    {
+      return 0;
+    }
+    state->sp += unzigzag(x);
+  }
+  if ((ext & TRACE_INTE) && !get_byte(cursor, &state->int_enable))
+  {
+    return 0;
+  }
+
+  cursor->instruction = cursor->next++;
+  return 1;
+}
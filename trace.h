@@ -0,0 +1,137 @@
+#ifndef I8080_TRACE_H
+#define I8080_TRACE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// Binary execution trace.
+//
+// One record per instruction, holding the state before it executes: a mask
+// byte of changed registers, the pc as a varint delta from the previous
+// instruction, the instruction bytes and the changed registers. A straight
+// run of register moves costs 3 to 5 bytes an instruction.
+//
+// The recording thread appends to its own ring of buffers; full buffers go
+// to a writer thread which hashes and writes them, so the emulator never
+// waits on the disk unless the ring is full. Each buffer starts with a
+// keyframe holding the complete cpu state, making it decodable on its own,
+// and becomes a checkpoint in the index at the end of the file:
+//
+//   "8080TRC1", u32 buffer size
+//   buffers
+//   index: per buffer u64 first instruction, offset, size, chained hash
+//   u64 index offset, u64 checkpoints, u64 instructions, "8080TIDX"
+//
+// The chained hash covers every byte up to the end of its buffer, so two
+// traces agree up to a checkpoint exactly when its hashes match.
+
+#define TRACE_BUFFER_SIZE  (256 * 1024)
+#define TRACE_BUFFERS      8
+#define TRACE_HEADER_SIZE  12
+#define TRACE_FOOTER_SIZE  32
+#define TRACE_MAX_RECORD   64   // room kept for a keyframe plus a record
+
+// Record mask bits
+#define TRACE_A     0x01
+#define TRACE_B     0x02
+#define TRACE_C     0x04
+#define TRACE_D     0x08
+#define TRACE_E     0x10
+#define TRACE_H     0x20
+#define TRACE_L     0x40
+#define TRACE_EXT   0x80   // an extension byte follows
+// Extension byte bits
+#define TRACE_FLAGS 0x01
+#define TRACE_SP    0x02   // varint sp delta
+#define TRACE_INTE  0x04
+#define TRACE_KEY   0x80   // keyframe: full state follows, no instruction
+
+typedef struct {
+  uint64_t instruction;   // index of the first instruction in the buffer
+  uint64_t offset;        // file offset of its keyframe
+  uint64_t size;
+  uint64_t hash;
+} TraceCheckpoint;
+
+typedef struct {
+  uint8_t *data[TRACE_BUFFERS];
+  size_t  size[TRACE_BUFFERS];
+  uint64_t first[TRACE_BUFFERS];   // first instruction in each buffer
+
+  // recording side
+  int      current;
+  size_t   pos;
+  uint64_t instructions;
+  CpuState last;           // registers in the previous record
+
+  // writer side
+  FILE     *file;
+  uint64_t offset;
+  uint64_t hash;
+  TraceCheckpoint *index;
+  uint64_t checkpoints;
+  uint64_t index_capacity;
+
+  pthread_t       writer;
+  pthread_mutex_t lock;
+  pthread_cond_t  ready;   // a buffer was filled, or closing
+  pthread_cond_t  drained; // the writer freed a buffer
+  int      head;           // oldest filled buffer
+  int      filled;         // buffers waiting for the writer
+  int      closing;
+  int      error;
+} TraceWriter;
+
+// Create the file and start the writer thread, NULL on error.
+TraceWriter* CreateTraceWriter(const char *filename);
+
+// Flush everything, write the index and free the writer.
+//   @return: 0 if anything failed to write
+int CloseTraceWriter(TraceWriter *trace);
+
+// Append the instruction at state->pc, before it executes.
+void TraceInstruction(TraceWriter *trace, CpuState *state);
+
+// MachineRunFrame, tracing every instruction.
+int MachineRunFrameTraced(Machine *machine, TraceWriter *trace);
+
+// A trace mapped for reading
+typedef struct {
+  const uint8_t   *data;
+  size_t          size;
+  uint32_t        buffer_size;
+  TraceCheckpoint *index;
+  uint64_t        checkpoints;
+  uint64_t        instructions;
+} TraceFile;
+
+// Map a trace, NULL with a message if it is not a complete trace.
+TraceFile* OpenTraceFile(const char *filename);
+void CloseTraceFile(TraceFile *trace);
+
+// Decoding position in a trace. After TraceNext returns 1, `state` holds
+// the registers before instruction number `instruction` and its bytes are in
+// `memory` at state.pc.
+typedef struct {
+  const TraceFile *trace;
+  uint64_t pos;
+  uint64_t end;            // end of the current buffer
+  uint64_t checkpoint;     // buffer being decoded
+  uint64_t instruction;
+  uint64_t next;           // index of the next instruction
+  uint64_t record;         // offset of the last record
+  CpuState state;
+  uint8_t  memory[I8080_MEMORY_SIZE + 2];
+} TraceCursor;
+
+// Position a cursor at the keyframe of a checkpoint.
+void TraceSeek(TraceCursor *cursor, const TraceFile *trace, uint64_t checkpoint);
+
+// Decode the next instruction.
+//   @return: 0 at the end of the trace or on a corrupt record
+int TraceNext(TraceCursor *cursor);
+
+#endif /* I8080_TRACE_H */
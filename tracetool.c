@@ -0,0 +1,283 @@
+#include "trace.h"
+#include "disassembler.h"
+
+// Matching instructions shown before a divergence
+#define DIFF_CONTEXT 8
+
+static void usage(void)
+{
+  printf("usage: tracetool <command> ...\n"
+         "  dump <trace> [first] [count]  print instructions as text, each with the\n"
+         "                                registers it left, like --trace\n"
+         "  info <trace>                  print size and checkpoints\n"
+         "  diff <trace> <trace>          find the first instruction that differs\n");
+}
+
+static int dump(const char *filename, uint64_t first, uint64_t count)
+{
+  TraceFile *trace = OpenTraceFile(filename);
+  if (trace == NULL)
+  {
+    return 1;
+  }
+
+  TraceCursor *cursor = malloc(sizeof(TraceCursor));
+  uint64_t c = 0;
+  int pending = 0;
+
+  //start from the last checkpoint at or before the first instruction
+  while (c + 1 < trace->checkpoints && trace->index[c + 1].instruction <= first)
+  {
+    c++;
+  }
+  TraceSeek(cursor, trace, c);
+
+  //a record holds the state before its instruction, so each line is ended
+  //with the registers of the next one: the state the instruction left, as
+  //--trace prints it
+  while ((pending || count > 0) && TraceNext(cursor))
+  {
+    if (pending)
+    {
+      print_state(&cursor->state);
+      pending = 0;
+    }
+    if (count > 0 && cursor->instruction >= first)
+    {
+      Disassemble8080Op(cursor->memory, cursor->state.pc);
+      pending = 1;
+      count--;
+    }
+  }
+  if (pending)
+  {
+    printf("\t(end of trace)\n");
+  }
+
+  free(cursor);
+  CloseTraceFile(trace);
+  return 0;
+}
+
+static int info(const char *filename)
+{
+  TraceFile *trace = OpenTraceFile(filename);
+  if (trace == NULL)
+  {
+    return 1;
+  }
+
+  printf("%s: %llu instructions, %zu bytes (%.2f bytes/instruction), "
+         "%llu checkpoints of %u bytes\n", filename,
+         (unsigned long long) trace->instructions, trace->size,
+         trace->instructions ? (double) trace->size / trace->instructions : 0.0,
+         (unsigned long long) trace->checkpoints, trace->buffer_size);
+  CloseTraceFile(trace);
+  return 0;
+}
+
+/* Diff */
+
+typedef struct {
+  uint64_t instruction;
+  CpuState state;
+  uint8_t  code[3];
+} DiffRecord;
+
+static void save_record(DiffRecord *record, TraceCursor *cursor)
+{
+  record->instruction = cursor->instruction;
+  record->state = cursor->state;
+  memcpy(record->code, &cursor->memory[cursor->state.pc], 3);
+}
+
+static void print_record(DiffRecord *record)
+{
+  static uint8_t memory[I8080_MEMORY_SIZE + 2];
+
+  memcpy(&memory[record->state.pc], record->code, 3);
+  printf("%12llu ", (unsigned long long) record->instruction);
+  Disassemble8080Op(memory, record->state.pc);
+  printf("%12s", "");
+  print_state(&record->state);
+}
+
+static int same_record(TraceCursor *a, TraceCursor *b)
+{
+  CpuState *x = &a->state;
+  CpuState *y = &b->state;
+
+  return x->pc == y->pc && x->sp == y->sp && x->a == y->a && x->b == y->b &&
+         x->c == y->c && x->d == y->d && x->e == y->e && x->h == y->h &&
+         x->l == y->l && x->cc.z == y->cc.z && x->cc.s == y->cc.s &&
+         x->cc.p == y->cc.p && x->cc.cy == y->cc.cy && x->cc.ac == y->cc.ac &&
+         x->int_enable == y->int_enable &&
+         memcmp(&a->memory[x->pc], &b->memory[y->pc], Length8080Op(a->memory[x->pc])) == 0;
+}
+
+static int same_checkpoint(TraceFile *a, TraceFile *b, uint64_t c)
+{
+  return a->index[c].instruction == b->index[c].instruction &&
+         a->index[c].size == b->index[c].size &&
+         a->index[c].hash == b->index[c].hash;
+}
+
+// Offset of the first differing byte, compared 32 bytes at a time
+static size_t first_difference(const uint8_t *a, const uint8_t *b, size_t size)
+{
+  size_t i = 0;
+
+  while (i + 32 <= size)
+  {
+    uint64_t x[4], y[4];
+    memcpy(x, a + i, 32);
+    memcpy(y, b + i, 32);
+    if (((x[0] ^ y[0]) | (x[1] ^ y[1]) | (x[2] ^ y[2]) | (x[3] ^ y[3])) != 0)
+    {
+      break;
+    }
+    i += 32;
+  }
+  while (i < size && a[i] == b[i])
+  {
+    i++;
+  }
+  return i;
+}
+
+static int diff(const char *filename_a, const char *filename_b)
+{
+  TraceFile *a = OpenTraceFile(filename_a);
+  TraceFile *b = a ? OpenTraceFile(filename_b) : NULL;
+  if (b == NULL)
+  {
+    if (a)
+    {
+      CloseTraceFile(a);
+    }
+    return 1;
+  }
+
+  // The chained hashes make matching checkpoints a prefix: binary search
+  // for the first one that differs. Traces cut into different buffer sizes
+  // have no common checkpoints and are compared from the start.
+  uint64_t low = 0;
+  uint64_t high = a->checkpoints < b->checkpoints ? a->checkpoints : b->checkpoints;
+  if (a->buffer_size != b->buffer_size)
+  {
+    high = 0;
+  }
+  while (low < high)
+  {
+    uint64_t mid = low + (high - low) / 2;
+    if (same_checkpoint(a, b, mid))
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  uint64_t checkpoint = low;
+
+  // Both sides of the first differing checkpoint start at the same offset
+  // and instruction; its bytes match up to `skip`, so records ending before
+  // that are decoded without comparing them.
+  uint64_t skip = 0;
+  if (checkpoint < a->checkpoints && checkpoint < b->checkpoints &&
+      a->index[checkpoint].offset == b->index[checkpoint].offset)
+  {
+    uint64_t offset = a->index[checkpoint].offset;
+    uint64_t size = a->index[checkpoint].size < b->index[checkpoint].size ?
+                    a->index[checkpoint].size : b->index[checkpoint].size;
+    skip = offset + first_difference(a->data + offset, b->data + offset, size);
+  }
+
+  TraceCursor *cursor_a = malloc(sizeof(TraceCursor));
+  TraceCursor *cursor_b = malloc(sizeof(TraceCursor));
+  DiffRecord context[DIFF_CONTEXT];
+  uint64_t matched = 0;
+  int more_a, more_b;
+
+  TraceSeek(cursor_a, a, checkpoint);
+  TraceSeek(cursor_b, b, checkpoint);
+  for (;;)
+  {
+    more_a = TraceNext(cursor_a);
+    more_b = TraceNext(cursor_b);
+    if (!more_a || !more_b)
+    {
+      break;
+    }
+    if (cursor_a->pos > skip && !same_record(cursor_a, cursor_b))
+    {
+      break;
+    }
+    save_record(&context[matched++ % DIFF_CONTEXT], cursor_a);
+  }
+
+  int result = 0;
+  if (!more_a && !more_b && a->instructions == b->instructions)
+  {
+    printf("traces match: %llu instructions\n", (unsigned long long) a->instructions);
+  }
+  else
+  {
+    uint64_t i;
+    uint64_t first = matched > DIFF_CONTEXT ? matched - DIFF_CONTEXT : 0;
+
+    printf("skipped %llu matching checkpoints\n", (unsigned long long) checkpoint);
+    for (i = first; i < matched; i++)
+    {
+      print_record(&context[i % DIFF_CONTEXT]);
+    }
+    if (more_a && more_b)
+    {
+      DiffRecord record;
+      printf("first divergence at instruction %llu\n",
+             (unsigned long long) cursor_a->instruction);
+      printf("%s:\n", filename_a);
+      save_record(&record, cursor_a);
+      print_record(&record);
+      printf("%s:\n", filename_b);
+      save_record(&record, cursor_b);
+      print_record(&record);
+    }
+    else
+    {
+      printf("%s ends at instruction %llu, %s has %llu\n",
+             more_a ? filename_b : filename_a,
+             (unsigned long long) (more_a ? b->instructions : a->instructions),
+             more_a ? filename_a : filename_b,
+             (unsigned long long) (more_a ? a->instructions : b->instructions));
+    }
+    result = 1;
+  }
+
+  free(cursor_a);
+  free(cursor_b);
+  CloseTraceFile(a);
+  CloseTraceFile(b);
+  return result;
+}
+
+int main (int argc, char** argv)
+{
+  if (argc >= 3 && argc <= 5 && strcmp(argv[1], "dump") == 0)
+  {
+    uint64_t first = argc > 3 ? strtoull(argv[3], NULL, 0) : 0;
+    uint64_t count = argc > 4 ? strtoull(argv[4], NULL, 0) : UINT64_MAX;
+    return dump(argv[2], first, count);
+  }
+  if (argc == 3 && strcmp(argv[1], "info") == 0)
+  {
+    return info(argv[2]);
+  }
+  if (argc == 4 && strcmp(argv[1], "diff") == 0)
+  {
+    return diff(argv[2], argv[3]);
+  }
+  usage();
+  return 1;
+}